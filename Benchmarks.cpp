@@ -0,0 +1,451 @@
+#include <benchmark/benchmark.h>
+#include <stdlib.h>
+#include <map>
+#include <opencv2/opencv.hpp>
+
+#include "BlockTransform.h"
+#include "HeaderOptions.h"
+#include "HuffmanTree.h"
+#include "StripeEncoder.h"
+#include "ofbitstream.h"
+#include "ifbitstream.h"
+#include "Utilities.h"
+#include "Zigzag.h"
+
+using namespace std;
+using namespace cv;
+
+/*
+	picts-bench: one benchmark per codec stage, each on one thread, on deterministic synthetic
+	images (arguments: width, height); bytes/s counts the image's samples (the bitstream's bytes
+	for the bitstream benchmarks) & per_block the time per 8x8 block of one channel
+*/
+
+#define BENCHMARK_QUALITY 50
+#define BENCHMARK_LAYERS 8
+
+// bitstream benchmarks: values written & read per iteration, 1 to 24 bits each
+#define BENCHMARK_BIT_VALUES (1 << 20)
+
+// everything the stages consume, built once per image size (untimed)
+struct BenchmarkImage
+{
+	Mat image, padded, yuv;
+	vector<Mat> channels;
+
+	// the YUV image in encoder stripes, & each stripe's DCT (StripeEncoder::Transform)
+	vector<Mat> stripes;
+	vector<vector<Mat> > transformed;
+
+	QuantizationTable luminance, chrominance;
+	HeaderOptions header;
+
+	// encoded to file; tree holds the encoder's layers, decoded its layers read back
+	string fileName;
+	HuffmanTree *tree, *decoded;
+	Mat coefficients;
+
+	uint64_t sampleBytes, blockCount;
+
+	BenchmarkImage(uint32_t, uint32_t);
+};
+
+static QuantizationTable _quantizationTable(bool chrominance)
+{
+	Mat* quantizationMatricies = Utilities::GenerateQuantizationMatricies((double)BENCHMARK_QUALITY);
+	QuantizationTable table(quantizationMatricies[chrominance].ptr<double>());
+	delete [] quantizationMatricies;
+
+	return table;
+}
+
+// gradients, hard edges & LCG noise, so every layer has symbols
+static Mat _syntheticImage(uint32_t width, uint32_t height)
+{
+	Mat image(height, width, CV_8UC3);
+	uint32_t seed = 0x5eed;
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		uint8_t* row = image.ptr<uint8_t>(y);
+
+		for (uint32_t x = 0; x < width; x++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			int noise = (seed >> 24) % 17 - 8, edge = ((x / 37) + (y / 23)) % 2 ? 48 : 0;
+
+			row[x * 3 + 0] = saturate_cast<uint8_t>((int)(x * 255 / width) + noise);
+			row[x * 3 + 1] = saturate_cast<uint8_t>((int)(y * 255 / height) + edge + noise);
+			row[x * 3 + 2] = saturate_cast<uint8_t>(128 + edge - noise);
+		}
+	}
+
+	return image;
+}
+
+static HuffmanTree* _encode(BenchmarkImage& bench)
+{
+	StripeEncoder encoder(bench.yuv.cols, 3, BENCHMARK_LAYERS, bench.luminance, bench.chrominance, 1);
+
+	for (Mat& stripe : bench.stripes)
+		encoder.AddStripe(stripe);
+
+	return encoder.Finish();
+}
+
+static void _serialize(HuffmanTree* tree, HeaderOptions header, string fileName)
+{
+	ofbitstream file(fileName);
+	header.Serialize(file);
+
+	for (uint8_t i = 0; i < header.getLayerCount(); i++)
+	{
+		LayerLocation location;
+
+		location.treeOffset = file.tellp();
+		tree->SerializeTree(file, i);
+
+		location.dataOffset = file.tellp();
+		tree->SerializeLayer(file, i);
+
+		location.treeSize = location.dataOffset - location.treeOffset;
+		location.dataSize = (uint64_t)file.tellp() - location.dataOffset;
+		header.setLayerLocation(i, location);
+	}
+
+	file.seekp(0);
+	header.Serialize(file);
+	file.close();
+}
+
+BenchmarkImage::BenchmarkImage(uint32_t width, uint32_t height)
+	: luminance(_quantizationTable(false)), chrominance(_quantizationTable(true))
+{
+	image = _syntheticImage(width, height);
+
+	uint32_t padWidth = (width + 7) / 8 * 8, padHeight = (height + 7) / 8 * 8;
+
+	padded.create(padHeight, padWidth, CV_8UC3);
+	Utilities::PadStripe(image, 0, padded);
+	cvtColor(padded, yuv, CV_BGR2YCrCb);
+	split(yuv, channels);
+
+	for (uint32_t top = 0; top < padHeight; top += STRIPE_BLOCK_ROWS * 8)
+	{
+		stripes.push_back(yuv(Rect(0, top, padWidth, min(padHeight - top, (uint32_t)STRIPE_BLOCK_ROWS * 8))).clone());
+		transformed.push_back(StripeEncoder::Transform(stripes.back(), 1));
+	}
+
+	header.setWidth(width);
+	header.setHeight(height);
+	header.setPadWidth(padWidth);
+	header.setPadHeight(padHeight);
+	header.setYUVColor(true);
+	header.setSubtract128(true);
+	header.setHuffmanCoding(true);
+	header.setRunLengthCoding(false);
+	header.setQuality(BENCHMARK_QUALITY);
+	header.setLayerCount(BENCHMARK_LAYERS);
+
+	const char* directory = getenv("TMPDIR");
+	fileName = string(directory ? directory : "/tmp") + "/picts-bench-" + to_string(width) + "x" + to_string(height) + ".picts";
+
+	tree = _encode(*this);
+	_serialize(tree, header, fileName);
+
+	decoded = HuffmanTree::Deserialize(fileName, header, 1);
+
+	Mat* decodedCoefficients = decoded->ToImage(header, 0, 1);
+	coefficients = *decodedCoefficients;
+	delete decodedCoefficients;
+
+	sampleBytes = (uint64_t)padWidth * padHeight * 3;
+	blockCount = sampleBytes / BLOCK_ELEMENTS;
+}
+
+static BenchmarkImage& _benchmarkImage(benchmark::State& state)
+{
+	static map<pair<int64_t, int64_t>, BenchmarkImage*> images;
+
+	BenchmarkImage*& bench = images[make_pair(state.range(0), state.range(1))];
+	if (!bench)
+		bench = new BenchmarkImage(state.range(0), state.range(1));
+
+	return *bench;
+}
+
+static void _setCounters(benchmark::State& state, uint64_t bytes, uint64_t blocks)
+{
+	state.SetBytesProcessed(state.iterations() * bytes);
+	state.counters["per_block"] = benchmark::Counter(blocks, benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+static void BM_Padding(benchmark::State& state)
+{
+	BenchmarkImage& bench = _benchmarkImage(state);
+	Mat stripe;
+
+	for (auto _ : state)
+		for (uint32_t top = 0; top < (uint32_t)bench.padded.rows; top += STRIPE_BLOCK_ROWS * 8)
+		{
+			stripe.create(min(bench.padded.rows - top, (uint32_t)STRIPE_BLOCK_ROWS * 8), bench.padded.cols, CV_8UC3);
+			Utilities::PadStripe(bench.image, top, stripe);
+			benchmark::DoNotOptimize(stripe.data);
+		}
+
+	_setCounters(state, bench.sampleBytes, bench.blockCount);
+}
+
+static void BM_ColorConversion(benchmark::State& state)
+{
+	BenchmarkImage& bench = _benchmarkImage(state);
+	Mat yuv;
+
+	for (auto _ : state)
+	{
+		cvtColor(bench.padded, yuv, CV_BGR2YCrCb);
+		benchmark::DoNotOptimize(yuv.data);
+	}
+
+	_setCounters(state, bench.sampleBytes, bench.blockCount);
+}
+
+static void BM_ForwardQuantize(benchmark::State& state)
+{
+	BenchmarkImage& bench = _benchmarkImage(state);
+	int16_t coefficients[BLOCK_ELEMENTS];
+
+	for (auto _ : state)
+		for (uint8_t i = 0; i < bench.channels.size(); i++)
+		{
+			const Mat& channel = bench.channels[i];
+			const QuantizationTable& table = !i ? bench.luminance : bench.chrominance;
+
+			for (int y = 0; y < channel.rows; y += 8)
+				for (int x = 0; x < channel.cols; x += 8)
+				{
+					BlockTransform::ForwardQuantize(channel.ptr<uint8_t>(y) + x, channel.step, table, coefficients);
+					benchmark::DoNotOptimize(coefficients);
+				}
+		}
+
+	state.SetLabel(BlockTransform::KernelName());
+	_setCounters(state, bench.sampleBytes, bench.blockCount);
+}
+
+static void BM_ZigzagGather(benchmark::State& state)
+{
+	BenchmarkImage& bench = _benchmarkImage(state);
+	const ZigzagLayout& layout = ZigzagLayouts[BENCHMARK_LAYERS];
+	int8_t block[BLOCK_ELEMENTS], zigzag[BLOCK_ELEMENTS];
+
+	for (int e = 0; e < BLOCK_ELEMENTS; e++)
+		block[e] = e - BLOCK_ELEMENTS / 2;
+
+	for (auto _ : state)
+		for (uint64_t b = 0; b < bench.blockCount; b++)
+		{
+			ZigzagGather(block, BLOCK_SIZE, layout, zigzag);
+			benchmark::DoNotOptimize(zigzag);
+		}
+
+	_setCounters(state, bench.sampleBytes, bench.blockCount);
+}
+
+// quantization of the DCT'd stripes, zigzag & the split into layer symbols
+static void BM_LayerSplit(benchmark::State& state)
+{
+	BenchmarkImage& bench = _benchmarkImage(state);
+
+	for (auto _ : state)
+	{
+		StripeEncoder encoder(bench.yuv.cols, 3, BENCHMARK_LAYERS, bench.luminance, bench.chrominance, 1);
+
+		for (vector<Mat>& stripe : bench.transformed)
+			encoder.AddStripe(stripe);
+	}
+
+	_setCounters(state, bench.sampleBytes, bench.blockCount);
+}
+
+// layer concatenation, symbol histograms, Huffman (package-merge) & rANS tables
+static void BM_CodeBuild(benchmark::State& state)
+{
+	BenchmarkImage& bench = _benchmarkImage(state);
+
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		StripeEncoder encoder(bench.yuv.cols, 3, BENCHMARK_LAYERS, bench.luminance, bench.chrominance, 1);
+
+		for (vector<Mat>& stripe : bench.transformed)
+			encoder.AddStripe(stripe);
+		state.ResumeTiming();
+
+		HuffmanTree* tree = encoder.Finish();
+
+		state.PauseTiming();
+		delete tree;
+		state.ResumeTiming();
+	}
+
+	_setCounters(state, bench.sampleBytes, bench.blockCount);
+}
+
+static void BM_SerializeLayer(benchmark::State& state)
+{
+	BenchmarkImage& bench = _benchmarkImage(state);
+	string fileName = bench.fileName + ".out";
+
+	for (auto _ : state)
+	{
+		ofbitstream file(fileName);
+
+		for (uint8_t i = 0; i < BENCHMARK_LAYERS; i++)
+		{
+			bench.tree->SerializeTree(file, i);
+			bench.tree->SerializeLayer(file, i);
+		}
+
+		file.close();
+	}
+
+	remove(fileName.c_str());
+	_setCounters(state, bench.sampleBytes, bench.blockCount);
+}
+
+static void BM_DeserializeLayer(benchmark::State& state)
+{
+	BenchmarkImage& bench = _benchmarkImage(state);
+	HeaderOptions header;
+
+	for (auto _ : state)
+	{
+		ifbitstream file(bench.fileName);
+		header = HeaderOptions::Deserialize(file);
+
+		for (uint8_t i = 0; i < header.getLayerCount(); i++)
+		{
+			file.seekg(header.getLayerLocation(i).treeOffset);
+
+			HuffmanCode code = HuffmanCode::Deserialize(file);
+			HuffmanDecoder decoder(code);
+
+			delete HuffmanTree::DeserializeLayer(file, decoder, header.getRunLengthCoding());
+		}
+	}
+
+	_setCounters(state, bench.sampleBytes, bench.blockCount);
+}
+
+static void BM_ToImage(benchmark::State& state)
+{
+	BenchmarkImage& bench = _benchmarkImage(state);
+
+	for (auto _ : state)
+		delete bench.decoded->ToImage(bench.header, 0, 1);
+
+	_setCounters(state, bench.sampleBytes, bench.blockCount);
+}
+
+// dequantization, inverse DCT & level shift of every block (the samples' copy is untimed)
+static void BM_DecompressImage(benchmark::State& state)
+{
+	BenchmarkImage& bench = _benchmarkImage(state);
+	Mat coefficients;
+
+	for (auto _ : state)
+	{
+		state.PauseTiming();
+		bench.coefficients.copyTo(coefficients);
+		state.ResumeTiming();
+
+		Utilities::DecompressImage(&coefficients, &bench.header, 1);
+		benchmark::DoNotOptimize(coefficients.data);
+	}
+
+	state.SetLabel(BlockTransform::KernelName());
+	_setCounters(state, bench.sampleBytes, bench.blockCount);
+}
+
+// the bitstream benchmarks' value lengths: 1 to 24 bits, in a fixed order
+static uint8_t _bitLength(uint32_t i)
+{
+	return 1 + (i * 7) % 24;
+}
+
+static uint64_t _bitStreamBytes()
+{
+	uint64_t bits = 0;
+
+	for (uint32_t i = 0; i < BENCHMARK_BIT_VALUES; i++)
+		bits += _bitLength(i);
+
+	return (bits + 7) / 8;
+}
+
+static string _bitStreamFileName()
+{
+	const char* directory = getenv("TMPDIR");
+	return string(directory ? directory : "/tmp") + "/picts-bench-bits";
+}
+
+static void _writeBitStream(string fileName)
+{
+	ofbitstream file(fileName);
+
+	for (uint32_t i = 0; i < BENCHMARK_BIT_VALUES; i++)
+		file.writeBits(i * 2654435761u, _bitLength(i));
+
+	file.close();
+}
+
+static void BM_ofbitstream(benchmark::State& state)
+{
+	string fileName = _bitStreamFileName() + ".out";
+
+	for (auto _ : state)
+		_writeBitStream(fileName);
+
+	remove(fileName.c_str());
+	state.SetBytesProcessed(state.iterations() * _bitStreamBytes());
+}
+
+static void BM_ifbitstream(benchmark::State& state)
+{
+	string fileName = _bitStreamFileName();
+	_writeBitStream(fileName);
+
+	for (auto _ : state)
+	{
+		ifbitstream file(fileName);
+		uint64_t sum = 0;
+
+		for (uint32_t i = 0; i < BENCHMARK_BIT_VALUES; i++)
+			sum += file.readBits(_bitLength(i));
+
+		benchmark::DoNotOptimize(sum);
+	}
+
+	remove(fileName.c_str());
+	state.SetBytesProcessed(state.iterations() * _bitStreamBytes());
+}
+
+// a multiple of 8 & a size that needs padding
+#define PICTS_BENCHMARK(function) BENCHMARK(function)->Args({ 1024, 768 })->Args({ 2043, 1531 })->Unit(benchmark::kMillisecond)
+
+PICTS_BENCHMARK(BM_Padding);
+PICTS_BENCHMARK(BM_ColorConversion);
+PICTS_BENCHMARK(BM_ForwardQuantize);
+PICTS_BENCHMARK(BM_ZigzagGather);
+PICTS_BENCHMARK(BM_LayerSplit);
+PICTS_BENCHMARK(BM_CodeBuild);
+PICTS_BENCHMARK(BM_SerializeLayer);
+PICTS_BENCHMARK(BM_DeserializeLayer);
+PICTS_BENCHMARK(BM_ToImage);
+PICTS_BENCHMARK(BM_DecompressImage);
+
+BENCHMARK(BM_ofbitstream)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ifbitstream)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,227 @@
+#include "BlockTransform.h"
+#include "BlockTransformPasses.h"
+
+#include <math.h>
+
+QuantizationTable::QuantizationTable(const double* values)
+{
+	for (int i = 0; i < BLOCK_ELEMENTS; i++)
+	{
+		reciprocals[i] = values[i] ? 1.0f / (8.0f * (float)values[i]) : 0.0f;
+		factors[i] = (int32_t)values[i];
+	}
+}
+
+// round half away from zero (as round()) & saturate to int16 (as packssdw)
+static inline int16_t _quantize(int32_t value, float reciprocal)
+{
+	float scaled = (float)value * reciprocal;
+	int32_t rounded = (int32_t)(fabsf(scaled) + 0.5f);
+
+	if (value < 0)
+		rounded = -rounded;
+
+	return rounded > INT16_MAX ? INT16_MAX : rounded < INT16_MIN ? INT16_MIN : rounded;
+}
+
+static inline int32_t _clamp16(int32_t value)
+{
+	return value > INT16_MAX ? INT16_MAX : value < INT16_MIN ? INT16_MIN : value;
+}
+
+// level shift & forward DCT of one block, as the SIMD kernels
+static inline void _forwardDCT(const uint8_t* samples, size_t stride, int32_t* block)
+{
+
+	// level shift & row pass
+	for (int y = 0; y < BLOCK_SIZE; y++)
+	{
+		int32_t* row = &block[y * BLOCK_SIZE];
+
+		for (int x = 0; x < BLOCK_SIZE; x++)
+			row[x] = (int32_t)samples[y * stride + x] - 128;
+
+		_forwardDCTPass<int32_t, 1>(row);
+	}
+
+	// column pass
+	for (int x = 0; x < BLOCK_SIZE; x++)
+	{
+		int32_t column[BLOCK_SIZE];
+
+		for (int y = 0; y < BLOCK_SIZE; y++)
+			column[y] = block[y * BLOCK_SIZE + x];
+
+		_forwardDCTPass<int32_t, 2>(column);
+
+		for (int y = 0; y < BLOCK_SIZE; y++)
+			block[y * BLOCK_SIZE + x] = column[y];
+	}
+}
+
+void BlockTransform::ForwardQuantizeScalar(const uint8_t* samples, size_t stride, const QuantizationTable& table, int16_t* coefficients)
+{
+	int32_t block[BLOCK_ELEMENTS];
+	_forwardDCT(samples, stride, block);
+
+	for (int i = 0; i < BLOCK_ELEMENTS; i++)
+		coefficients[i] = _quantize(block[i], table.reciprocals[i]);
+}
+
+void BlockTransform::Forward(const uint8_t* samples, size_t stride, int16_t* values)
+{
+	int32_t block[BLOCK_ELEMENTS];
+	_forwardDCT(samples, stride, block);
+
+	for (int i = 0; i < BLOCK_ELEMENTS; i++)
+		values[i] = block[i];
+}
+
+void BlockTransform::Quantize(const int16_t* values, const QuantizationTable& table, int16_t* coefficients)
+{
+	for (int i = 0; i < BLOCK_ELEMENTS; i++)
+		coefficients[i] = _quantize(values[i], table.reciprocals[i]);
+}
+
+void BlockTransform::DequantizeInverseScalar(const int16_t* coefficients, const QuantizationTable& table, uint8_t* samples, size_t stride)
+{
+	int32_t block[BLOCK_ELEMENTS];
+
+	// dequantize & column pass
+	for (int x = 0; x < BLOCK_SIZE; x++)
+	{
+		int32_t column[BLOCK_SIZE];
+
+		for (int y = 0; y < BLOCK_SIZE; y++)
+			column[y] = _clamp16(coefficients[y * BLOCK_SIZE + x] * table.factors[y * BLOCK_SIZE + x]);
+
+		_inverseDCTPass<int32_t, 1>(column);
+
+		for (int y = 0; y < BLOCK_SIZE; y++)
+			block[y * BLOCK_SIZE + x] = _clamp16(column[y]);
+	}
+
+	// row pass, level shift & clamp
+	for (int y = 0; y < BLOCK_SIZE; y++)
+	{
+		int32_t* row = &block[y * BLOCK_SIZE];
+
+		_inverseDCTPass<int32_t, 2>(row);
+
+		for (int x = 0; x < BLOCK_SIZE; x++)
+		{
+			int32_t sample = row[x] + 128;
+			samples[y * stride + x] = sample > 255 ? 255 : sample < 0 ? 0 : sample;
+		}
+	}
+}
+
+void BlockTransform::ForwardQuantize(const uint8_t* samples, size_t stride, const QuantizationTable& table, int16_t* coefficients)
+{
+	typedef void (*Kernel)(const uint8_t*, size_t, const QuantizationTable&, int16_t*);
+
+	static Kernel kernel =
+#ifdef PICTS_X86_SIMD
+		_kernelLevel() == AVX2 ? ForwardQuantizeAVX2 :
+		_kernelLevel() == SSE41 ? ForwardQuantizeSSE41 :
+#endif
+		ForwardQuantizeScalar;
+
+	kernel(samples, stride, table, coefficients);
+}
+
+void BlockTransform::DequantizeInverse(const int16_t* coefficients, const QuantizationTable& table, uint8_t* samples, size_t stride)
+{
+	typedef void (*Kernel)(const int16_t*, const QuantizationTable&, uint8_t*, size_t);
+
+	static Kernel kernel =
+#ifdef PICTS_X86_SIMD
+		_kernelLevel() == AVX2 ? DequantizeInverseAVX2 :
+		_kernelLevel() == SSE41 ? DequantizeInverseSSE41 :
+#endif
+		DequantizeInverseScalar;
+
+	kernel(coefficients, table, samples, stride);
+}
+
+// size-point inverse DCT bases with the 8-point normalization, so a block's mean is kept
+//	at every size: basis[size][x][u] = C(u) / 2 * cos((2x + 1)u * pi / (2 * size))
+struct ScaledIDCTBasis
+{
+	float basis[BLOCK_SIZE + 1][BLOCK_SIZE][BLOCK_SIZE];
+
+	ScaledIDCTBasis()
+	{
+		for (int size = 1; size <= BLOCK_SIZE; size++)
+			for (int x = 0; x < size; x++)
+				for (int u = 0; u < size; u++)
+					basis[size][x][u] = (u ? 0.5 : 0.5 / sqrt(2.0)) * cos((2 * x + 1) * u * M_PI / (2 * size));
+	}
+};
+
+void BlockTransform::DequantizeInverseScaled(const int16_t* coefficients, const QuantizationTable& table, uint8_t size, uint8_t* samples, size_t stride)
+{
+	if (size >= BLOCK_SIZE)
+	{
+		DequantizeInverse(coefficients, table, samples, stride);
+		return;
+	}
+
+	static const ScaledIDCTBasis bases;
+	const float (*basis)[BLOCK_SIZE] = bases.basis[size];
+
+	// dequantize & column pass: columns[y][u]
+	float columns[BLOCK_SIZE][BLOCK_SIZE];
+
+	for (int u = 0; u < size; u++)
+		for (int y = 0; y < size; y++)
+		{
+			float sum = 0.0f;
+
+			for (int v = 0; v < size; v++)
+				sum += basis[y][v] * (float)(coefficients[v * BLOCK_SIZE + u] * table.factors[v * BLOCK_SIZE + u]);
+
+			columns[y][u] = sum;
+		}
+
+	// row pass, level shift & clamp
+	for (int y = 0; y < size; y++)
+		for (int x = 0; x < size; x++)
+		{
+			float sum = 128.5f;
+
+			for (int u = 0; u < size; u++)
+				sum += basis[x][u] * columns[y][u];
+
+			int32_t sample = (int32_t)floorf(sum);
+			samples[y * stride + x] = sample > 255 ? 255 : sample < 0 ? 0 : sample;
+		}
+}
+
+BlockTransform::KernelLevel BlockTransform::_kernelLevel()
+{
+#ifdef PICTS_X86_SIMD
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx2"))
+		return AVX2;
+
+	if (__builtin_cpu_supports("sse4.1"))
+		return SSE41;
+#endif
+
+	return Scalar;
+}
+
+const char* BlockTransform::KernelName()
+{
+	switch (_kernelLevel())
+	{
+		case AVX2:
+			return "avx2";
+		case SSE41:
+			return "sse4.1";
+		default:
+			return "scalar";
+	}
+}
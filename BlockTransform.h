@@ -0,0 +1,68 @@
+#ifndef BlockTransform_h
+#define BlockTransform_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+using namespace std;
+
+#define BLOCK_SIZE 8
+#define BLOCK_ELEMENTS (BLOCK_SIZE * BLOCK_SIZE)
+
+// per-coefficient quantization factors in the form the block kernels consume
+struct QuantizationTable
+{
+	// 8x8 row-major quantization matrix (e.g. Utilities::GenerateQuantizationMatricies)
+	QuantizationTable(const double*);
+
+	// 1 / (8 * q); the integer DCT output is scaled up by 8
+	//	a 0 quantizer yields 0, matching cv::divide
+	float reciprocals[BLOCK_ELEMENTS];
+
+	// q, for dequantization
+	int32_t factors[BLOCK_ELEMENTS];
+};
+
+class BlockTransform
+{
+	public:
+		// level shift (-128), forward DCT, quantize & round one 8x8 block of samples
+		//	into natural-order coefficients; picks the widest kernel the CPU supports
+		static void ForwardQuantize(const uint8_t*, size_t, const QuantizationTable&, int16_t*);
+
+		// ForwardQuantize in two steps, so one transform can be quantized with several tables:
+		//	level shift & forward DCT into natural-order values (scaled by 8; they fit int16),
+		//	then quantize & round those as ForwardQuantize does; Forward + Quantize is bit-identical
+		static void Forward(const uint8_t*, size_t, int16_t*);
+		static void Quantize(const int16_t*, const QuantizationTable&, int16_t*);
+
+		// dequantize, inverse DCT, level shift (+128) & clamp one block of natural-order
+		//	coefficients into 8-bit samples; picks the widest kernel the CPU supports
+		static void DequantizeInverse(const int16_t*, const QuantizationTable&, uint8_t*, size_t);
+
+		// dequantize & inverse DCT only the top-left size x size coefficients into a size x size
+		//	block, the block at size/8 scale (as libjpeg's scaled IDCTs); 1 is DC only, 8 is DequantizeInverse
+		static void DequantizeInverseScaled(const int16_t*, const QuantizationTable&, uint8_t, uint8_t*, size_t);
+
+		// reference kernels; the SIMD kernels produce bit-identical output
+		static void ForwardQuantizeScalar(const uint8_t*, size_t, const QuantizationTable&, int16_t*);
+		static void DequantizeInverseScalar(const int16_t*, const QuantizationTable&, uint8_t*, size_t);
+
+#ifdef PICTS_X86_SIMD
+		static void ForwardQuantizeSSE41(const uint8_t*, size_t, const QuantizationTable&, int16_t*);
+		static void DequantizeInverseSSE41(const int16_t*, const QuantizationTable&, uint8_t*, size_t);
+
+		static void ForwardQuantizeAVX2(const uint8_t*, size_t, const QuantizationTable&, int16_t*);
+		static void DequantizeInverseAVX2(const int16_t*, const QuantizationTable&, uint8_t*, size_t);
+#endif
+
+		// name of the kernels ForwardQuantize & DequantizeInverse dispatch to
+		static const char* KernelName();
+
+	private:
+		enum KernelLevel { Scalar, SSE41, AVX2 };
+
+		static KernelLevel _kernelLevel();
+};
+
+#endif
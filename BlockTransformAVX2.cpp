@@ -0,0 +1,114 @@
+// compiled with -mavx2; only reached after BlockTransform checks the CPU
+
+#include <immintrin.h>
+
+#include "BlockTransform.h"
+#include "BlockTransformPasses.h"
+
+// eight int32 lanes: one row (or column) of a block
+struct AVX2Lanes
+{
+	__m256i v;
+
+	AVX2Lanes() { }
+	AVX2Lanes(__m256i value) : v(value) { }
+	explicit AVX2Lanes(int32_t value) : v(_mm256_set1_epi32(value)) { }
+};
+
+static inline AVX2Lanes operator+ (AVX2Lanes a, AVX2Lanes b) { return _mm256_add_epi32(a.v, b.v); }
+static inline AVX2Lanes operator- (AVX2Lanes a, AVX2Lanes b) { return _mm256_sub_epi32(a.v, b.v); }
+static inline AVX2Lanes operator* (AVX2Lanes a, int32_t b) { return _mm256_mullo_epi32(a.v, _mm256_set1_epi32(b)); }
+static inline AVX2Lanes operator<< (AVX2Lanes a, int bits) { return _mm256_slli_epi32(a.v, bits); }
+static inline AVX2Lanes operator>> (AVX2Lanes a, int bits) { return _mm256_srai_epi32(a.v, bits); }
+
+static inline AVX2Lanes _clamp16(AVX2Lanes a)
+{
+	return _mm256_max_epi32(_mm256_min_epi32(a.v, _mm256_set1_epi32(INT16_MAX)), _mm256_set1_epi32(INT16_MIN));
+}
+
+static inline void _transpose(AVX2Lanes* r)
+{
+	__m256i t0 = _mm256_unpacklo_epi32(r[0].v, r[1].v), t1 = _mm256_unpackhi_epi32(r[0].v, r[1].v),
+			t2 = _mm256_unpacklo_epi32(r[2].v, r[3].v), t3 = _mm256_unpackhi_epi32(r[2].v, r[3].v),
+			t4 = _mm256_unpacklo_epi32(r[4].v, r[5].v), t5 = _mm256_unpackhi_epi32(r[4].v, r[5].v),
+			t6 = _mm256_unpacklo_epi32(r[6].v, r[7].v), t7 = _mm256_unpackhi_epi32(r[6].v, r[7].v);
+
+	__m256i u0 = _mm256_unpacklo_epi64(t0, t2), u1 = _mm256_unpackhi_epi64(t0, t2),
+			u2 = _mm256_unpacklo_epi64(t1, t3), u3 = _mm256_unpackhi_epi64(t1, t3),
+			u4 = _mm256_unpacklo_epi64(t4, t6), u5 = _mm256_unpackhi_epi64(t4, t6),
+			u6 = _mm256_unpacklo_epi64(t5, t7), u7 = _mm256_unpackhi_epi64(t5, t7);
+
+	r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+	r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+	r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+	r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+	r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+	r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+	r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+	r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
+
+void BlockTransform::ForwardQuantizeAVX2(const uint8_t* samples, size_t stride, const QuantizationTable& table, int16_t* coefficients)
+{
+	AVX2Lanes d[BLOCK_SIZE];
+	const __m256i center = _mm256_set1_epi32(128);
+
+	// level shift; d[y] holds row y
+	for (int y = 0; y < BLOCK_SIZE; y++)
+		d[y] = _mm256_sub_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(samples + y * stride))), center);
+
+	// d[x] holds column x of every row: the pass transforms all 8 rows at once
+	_transpose(d);
+	_forwardDCTPass<AVX2Lanes, 1>(d);
+
+	// back to rows: the pass transforms all 8 columns at once
+	_transpose(d);
+	_forwardDCTPass<AVX2Lanes, 2>(d);
+
+	const __m256 half = _mm256_set1_ps(0.5f),
+				 signMask = _mm256_set1_ps(-0.0f);
+
+	for (int y = 0; y < BLOCK_SIZE; y++)
+	{
+		// round half away from zero, as the scalar kernel
+		__m256 scaled = _mm256_mul_ps(_mm256_cvtepi32_ps(d[y].v), _mm256_loadu_ps(&table.reciprocals[y * BLOCK_SIZE]));
+		__m256i rounded = _mm256_cvttps_epi32(_mm256_add_ps(_mm256_andnot_ps(signMask, scaled), half));
+		rounded = _mm256_sign_epi32(rounded, d[y].v);
+
+		__m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(rounded), _mm256_extracti128_si256(rounded, 1));
+		_mm_storeu_si128((__m128i*)&coefficients[y * BLOCK_SIZE], packed);
+	}
+}
+
+void BlockTransform::DequantizeInverseAVX2(const int16_t* coefficients, const QuantizationTable& table, uint8_t* samples, size_t stride)
+{
+	AVX2Lanes d[BLOCK_SIZE];
+
+	// dequantize; d[y] holds row y: the pass transforms all 8 columns at once
+	for (int y = 0; y < BLOCK_SIZE; y++)
+	{
+		__m256i values = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)&coefficients[y * BLOCK_SIZE]));
+		d[y] = _clamp16(_mm256_mullo_epi32(values, _mm256_loadu_si256((const __m256i*)&table.factors[y * BLOCK_SIZE])));
+	}
+
+	_inverseDCTPass<AVX2Lanes, 1>(d);
+
+	for (int y = 0; y < BLOCK_SIZE; y++)
+		d[y] = _clamp16(d[y]);
+
+	// d[x] holds column x of every row: the pass transforms all 8 rows at once
+	_transpose(d);
+	_inverseDCTPass<AVX2Lanes, 2>(d);
+	_transpose(d);
+
+	// level shift & clamp to 0..255
+	const __m256i center = _mm256_set1_epi32(128);
+
+	for (int y = 0; y < BLOCK_SIZE; y++)
+	{
+		__m256i shifted = _mm256_add_epi32(d[y].v, center);
+		__m128i words = _mm_packs_epi32(_mm256_castsi256_si128(shifted), _mm256_extracti128_si256(shifted, 1));
+
+		_mm_storel_epi64((__m128i*)(samples + y * stride), _mm_packus_epi16(words, words));
+	}
+}
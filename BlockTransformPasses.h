@@ -0,0 +1,139 @@
+#ifndef BlockTransformPasses_h
+#define BlockTransformPasses_h
+
+// 1-D passes of the Loeffler-Ligtenberg-Moschytz integer DCT (IJG jfdctint.c & jidctint.c)
+//	V is int32_t for the scalar kernel or a vector of int32 lanes for the SIMD kernels;
+//	every kernel runs the same integer arithmetic, so all of them agree bit-for-bit
+
+#define DCT_CONST_BITS 13
+#define DCT_PASS1_BITS 2
+
+#define DCT_FIX_0_298631336 2446
+#define DCT_FIX_0_390180644 3196
+#define DCT_FIX_0_541196100 4433
+#define DCT_FIX_0_765366865 6270
+#define DCT_FIX_0_899976223 7373
+#define DCT_FIX_1_175875602 9633
+#define DCT_FIX_1_501321110 12299
+#define DCT_FIX_1_847759065 15137
+#define DCT_FIX_1_961570560 16069
+#define DCT_FIX_2_053119869 16819
+#define DCT_FIX_2_562915447 20995
+#define DCT_FIX_3_072711026 25172
+
+template<typename V>
+inline V _dctDescale(V value, int bits)
+{
+	return (value + V(1 << (bits - 1))) >> bits;
+}
+
+// pass 1 (rows) keeps DCT_PASS1_BITS of extra precision; pass 2 (columns) removes it
+//	output of pass 2 is the orthonormal DCT scaled up by 8
+template<typename V, int pass>
+inline void _forwardDCTPass(V* d)
+{
+	const int shift = pass == 1 ? DCT_CONST_BITS - DCT_PASS1_BITS : DCT_CONST_BITS + DCT_PASS1_BITS;
+
+	V tmp0 = d[0] + d[7], tmp7 = d[0] - d[7],
+	  tmp1 = d[1] + d[6], tmp6 = d[1] - d[6],
+	  tmp2 = d[2] + d[5], tmp5 = d[2] - d[5],
+	  tmp3 = d[3] + d[4], tmp4 = d[3] - d[4];
+
+	// even part
+	V tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3,
+	  tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+	if (pass == 1)
+	{
+		d[0] = (tmp10 + tmp11) << DCT_PASS1_BITS;
+		d[4] = (tmp10 - tmp11) << DCT_PASS1_BITS;
+	}
+	else
+	{
+		d[0] = _dctDescale(tmp10 + tmp11, DCT_PASS1_BITS);
+		d[4] = _dctDescale(tmp10 - tmp11, DCT_PASS1_BITS);
+	}
+
+	V z1 = (tmp12 + tmp13) * DCT_FIX_0_541196100;
+	d[2] = _dctDescale(z1 + tmp13 * DCT_FIX_0_765366865, shift);
+	d[6] = _dctDescale(z1 + tmp12 * -DCT_FIX_1_847759065, shift);
+
+	// odd part
+	z1 = tmp4 + tmp7;
+	V z2 = tmp5 + tmp6,
+	  z3 = tmp4 + tmp6,
+	  z4 = tmp5 + tmp7,
+	  z5 = (z3 + z4) * DCT_FIX_1_175875602;
+
+	tmp4 = tmp4 * DCT_FIX_0_298631336;
+	tmp5 = tmp5 * DCT_FIX_2_053119869;
+	tmp6 = tmp6 * DCT_FIX_3_072711026;
+	tmp7 = tmp7 * DCT_FIX_1_501321110;
+	z1 = z1 * -DCT_FIX_0_899976223;
+	z2 = z2 * -DCT_FIX_2_562915447;
+	z3 = z3 * -DCT_FIX_1_961570560 + z5;
+	z4 = z4 * -DCT_FIX_0_390180644 + z5;
+
+	d[7] = _dctDescale(tmp4 + z1 + z3, shift);
+	d[5] = _dctDescale(tmp5 + z2 + z4, shift);
+	d[3] = _dctDescale(tmp6 + z2 + z3, shift);
+	d[1] = _dctDescale(tmp7 + z1 + z4, shift);
+}
+
+// pass 1 (columns) keeps DCT_PASS1_BITS of extra precision; pass 2 (rows) removes it & the 8x
+//	scale of the two passes, leaving samples; the kernels clamp inputs & pass 1 output to int16,
+//	which bounds every intermediate below 2^31
+template<typename V, int pass>
+inline void _inverseDCTPass(V* d)
+{
+	const int shift = pass == 1 ? DCT_CONST_BITS - DCT_PASS1_BITS : DCT_CONST_BITS + DCT_PASS1_BITS + 3;
+
+	// even part
+	V z2 = d[2], z3 = d[6],
+	  z1 = (z2 + z3) * DCT_FIX_0_541196100,
+	  tmp2 = z1 + z3 * -DCT_FIX_1_847759065,
+	  tmp3 = z1 + z2 * DCT_FIX_0_765366865;
+
+	V tmp0 = (d[0] + d[4]) << DCT_CONST_BITS,
+	  tmp1 = (d[0] - d[4]) << DCT_CONST_BITS;
+
+	V tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3,
+	  tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+	// odd part
+	tmp0 = d[7];
+	tmp1 = d[5];
+	tmp2 = d[3];
+	tmp3 = d[1];
+
+	z1 = tmp0 + tmp3;
+	z2 = tmp1 + tmp2;
+	z3 = tmp0 + tmp2;
+	V z4 = tmp1 + tmp3,
+	  z5 = (z3 + z4) * DCT_FIX_1_175875602;
+
+	tmp0 = tmp0 * DCT_FIX_0_298631336;
+	tmp1 = tmp1 * DCT_FIX_2_053119869;
+	tmp2 = tmp2 * DCT_FIX_3_072711026;
+	tmp3 = tmp3 * DCT_FIX_1_501321110;
+	z1 = z1 * -DCT_FIX_0_899976223;
+	z2 = z2 * -DCT_FIX_2_562915447;
+	z3 = z3 * -DCT_FIX_1_961570560 + z5;
+	z4 = z4 * -DCT_FIX_0_390180644 + z5;
+
+	tmp0 = tmp0 + z1 + z3;
+	tmp1 = tmp1 + z2 + z4;
+	tmp2 = tmp2 + z2 + z3;
+	tmp3 = tmp3 + z1 + z4;
+
+	d[0] = _dctDescale(tmp10 + tmp3, shift);
+	d[7] = _dctDescale(tmp10 - tmp3, shift);
+	d[1] = _dctDescale(tmp11 + tmp2, shift);
+	d[6] = _dctDescale(tmp11 - tmp2, shift);
+	d[2] = _dctDescale(tmp12 + tmp1, shift);
+	d[5] = _dctDescale(tmp12 - tmp1, shift);
+	d[3] = _dctDescale(tmp13 + tmp0, shift);
+	d[4] = _dctDescale(tmp13 - tmp0, shift);
+}
+
+#endif
@@ -0,0 +1,133 @@
+// compiled with -msse4.1; only reached after BlockTransform checks the CPU
+
+#include <smmintrin.h>
+
+#include "BlockTransform.h"
+#include "BlockTransformPasses.h"
+
+// eight int32 lanes in two registers: one row (or column) of a block
+struct SSELanes
+{
+	__m128i lo, hi;
+
+	SSELanes() { }
+	SSELanes(__m128i low, __m128i high) : lo(low), hi(high) { }
+	explicit SSELanes(int32_t value) : lo(_mm_set1_epi32(value)), hi(lo) { }
+};
+
+static inline SSELanes operator+ (SSELanes a, SSELanes b) { return SSELanes(_mm_add_epi32(a.lo, b.lo), _mm_add_epi32(a.hi, b.hi)); }
+static inline SSELanes operator- (SSELanes a, SSELanes b) { return SSELanes(_mm_sub_epi32(a.lo, b.lo), _mm_sub_epi32(a.hi, b.hi)); }
+static inline SSELanes operator<< (SSELanes a, int bits) { return SSELanes(_mm_slli_epi32(a.lo, bits), _mm_slli_epi32(a.hi, bits)); }
+static inline SSELanes operator>> (SSELanes a, int bits) { return SSELanes(_mm_srai_epi32(a.lo, bits), _mm_srai_epi32(a.hi, bits)); }
+
+static inline SSELanes operator* (SSELanes a, int32_t b)
+{
+	__m128i factor = _mm_set1_epi32(b);
+	return SSELanes(_mm_mullo_epi32(a.lo, factor), _mm_mullo_epi32(a.hi, factor));
+}
+
+static inline SSELanes _clamp16(SSELanes a)
+{
+	const __m128i high = _mm_set1_epi32(INT16_MAX), low = _mm_set1_epi32(INT16_MIN);
+	return SSELanes(_mm_max_epi32(_mm_min_epi32(a.lo, high), low), _mm_max_epi32(_mm_min_epi32(a.hi, high), low));
+}
+
+static inline void _transpose4(__m128i& r0, __m128i& r1, __m128i& r2, __m128i& r3)
+{
+	__m128i t0 = _mm_unpacklo_epi32(r0, r1), t1 = _mm_unpackhi_epi32(r0, r1),
+			t2 = _mm_unpacklo_epi32(r2, r3), t3 = _mm_unpackhi_epi32(r2, r3);
+
+	r0 = _mm_unpacklo_epi64(t0, t2);
+	r1 = _mm_unpackhi_epi64(t0, t2);
+	r2 = _mm_unpacklo_epi64(t1, t3);
+	r3 = _mm_unpackhi_epi64(t1, t3);
+}
+
+// transpose each 4x4 quadrant, then swap the off-diagonal quadrants
+static inline void _transpose(SSELanes* r)
+{
+	_transpose4(r[0].lo, r[1].lo, r[2].lo, r[3].lo);
+	_transpose4(r[0].hi, r[1].hi, r[2].hi, r[3].hi);
+	_transpose4(r[4].lo, r[5].lo, r[6].lo, r[7].lo);
+	_transpose4(r[4].hi, r[5].hi, r[6].hi, r[7].hi);
+
+	for (int i = 0; i < 4; i++)
+	{
+		__m128i swap = r[i].hi;
+		r[i].hi = r[i + 4].lo;
+		r[i + 4].lo = swap;
+	}
+}
+
+void BlockTransform::ForwardQuantizeSSE41(const uint8_t* samples, size_t stride, const QuantizationTable& table, int16_t* coefficients)
+{
+	SSELanes d[BLOCK_SIZE];
+	const __m128i center = _mm_set1_epi32(128);
+
+	// level shift; d[y] holds row y
+	for (int y = 0; y < BLOCK_SIZE; y++)
+	{
+		__m128i row = _mm_loadl_epi64((const __m128i*)(samples + y * stride));
+		d[y] = SSELanes(_mm_sub_epi32(_mm_cvtepu8_epi32(row), center), _mm_sub_epi32(_mm_cvtepu8_epi32(_mm_srli_si128(row, 4)), center));
+	}
+
+	// d[x] holds column x of every row: the pass transforms all 8 rows at once
+	_transpose(d);
+	_forwardDCTPass<SSELanes, 1>(d);
+
+	// back to rows: the pass transforms all 8 columns at once
+	_transpose(d);
+	_forwardDCTPass<SSELanes, 2>(d);
+
+	const __m128 half = _mm_set1_ps(0.5f),
+				 signMask = _mm_set1_ps(-0.0f);
+
+	for (int y = 0; y < BLOCK_SIZE; y++)
+	{
+		const float* reciprocals = &table.reciprocals[y * BLOCK_SIZE];
+
+		// round half away from zero, as the scalar kernel
+		__m128 low = _mm_mul_ps(_mm_cvtepi32_ps(d[y].lo), _mm_loadu_ps(reciprocals)),
+			   high = _mm_mul_ps(_mm_cvtepi32_ps(d[y].hi), _mm_loadu_ps(reciprocals + 4));
+
+		__m128i roundedLow = _mm_sign_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_andnot_ps(signMask, low), half)), d[y].lo),
+				roundedHigh = _mm_sign_epi32(_mm_cvttps_epi32(_mm_add_ps(_mm_andnot_ps(signMask, high), half)), d[y].hi);
+
+		_mm_storeu_si128((__m128i*)&coefficients[y * BLOCK_SIZE], _mm_packs_epi32(roundedLow, roundedHigh));
+	}
+}
+
+void BlockTransform::DequantizeInverseSSE41(const int16_t* coefficients, const QuantizationTable& table, uint8_t* samples, size_t stride)
+{
+	SSELanes d[BLOCK_SIZE];
+
+	// dequantize; d[y] holds row y: the pass transforms all 8 columns at once
+	for (int y = 0; y < BLOCK_SIZE; y++)
+	{
+		__m128i values = _mm_loadu_si128((const __m128i*)&coefficients[y * BLOCK_SIZE]);
+		const __m128i* factors = (const __m128i*)&table.factors[y * BLOCK_SIZE];
+
+		d[y] = _clamp16(SSELanes(_mm_mullo_epi32(_mm_cvtepi16_epi32(values), _mm_loadu_si128(factors)),
+								 _mm_mullo_epi32(_mm_cvtepi16_epi32(_mm_srli_si128(values, 8)), _mm_loadu_si128(factors + 1))));
+	}
+
+	_inverseDCTPass<SSELanes, 1>(d);
+
+	for (int y = 0; y < BLOCK_SIZE; y++)
+		d[y] = _clamp16(d[y]);
+
+	// d[x] holds column x of every row: the pass transforms all 8 rows at once
+	_transpose(d);
+	_inverseDCTPass<SSELanes, 2>(d);
+	_transpose(d);
+
+	// level shift & clamp to 0..255
+	const __m128i center = _mm_set1_epi32(128);
+
+	for (int y = 0; y < BLOCK_SIZE; y++)
+	{
+		__m128i words = _mm_packs_epi32(_mm_add_epi32(d[y].lo, center), _mm_add_epi32(d[y].hi, center));
+
+		_mm_storel_epi64((__m128i*)(samples + y * stride), _mm_packus_epi16(words, words));
+	}
+}
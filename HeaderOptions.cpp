@@ -1,14 +1,21 @@
 #include <iostream>
 
 #include "HeaderOptions.h"
+#include "Zigzag.h"
 
 using namespace std;
 
+HeaderOptions::HeaderOptions()
+	: _width(0), _height(0), _padWidth(0), _padHeight(0),
+	  _yuvColor(false), _subtract128(false), _huffmanCoding(false), _runLengthCoding(false),
+	  _layerCount(0), _quailty(0), _version(PICTS_VERSION) { }
+
 void HeaderOptions::Serialize (ostream& outputStream)
 {
 	outputStream.write("PICTS", 5);
 
-	uint8_t flags = (_layerCount & 0x0f) | (_yuvColor << 7 & 0x80) | (_huffmanCoding << 6 & 0x40) | (_subtract128 << 5 & 0x20);
+	// 0x10: version byte & layer table follow the quality
+	uint8_t flags = (_layerCount & 0x0f) | (_yuvColor << 7 & 0x80) | (_huffmanCoding << 6 & 0x40) | (_subtract128 << 5 & 0x20) | 0x10;
 
 	outputStream.write(reinterpret_cast<const char*>(&flags), 1);
 	outputStream.write(reinterpret_cast<const char*>(&_width), sizeof(_width));
@@ -16,6 +23,22 @@ void HeaderOptions::Serialize (ostream& outputStream)
 	outputStream.write(reinterpret_cast<const char*>(&_padWidth), sizeof(_padWidth));
 	outputStream.write(reinterpret_cast<const char*>(&_padHeight), sizeof(_padHeight));
 	outputStream.write(reinterpret_cast<const char*>(&_quailty), sizeof(_quailty));
+
+	uint8_t version = PICTS_VERSION;
+	outputStream.write(reinterpret_cast<const char*>(&version), sizeof(version));
+
+	uint8_t codingFlags = _runLengthCoding ? PICTS_CODING_RUN_LENGTH : 0;
+	outputStream.write(reinterpret_cast<const char*>(&codingFlags), sizeof(codingFlags));
+
+	for (uint8_t i = 0; i < _layerCount; i++)
+	{
+		LayerLocation location = i < _layerTable.size() ? _layerTable[i] : LayerLocation { 0, 0, 0, 0 };
+
+		outputStream.write(reinterpret_cast<const char*>(&location.treeOffset), sizeof(location.treeOffset));
+		outputStream.write(reinterpret_cast<const char*>(&location.treeSize), sizeof(location.treeSize));
+		outputStream.write(reinterpret_cast<const char*>(&location.dataOffset), sizeof(location.dataOffset));
+		outputStream.write(reinterpret_cast<const char*>(&location.dataSize), sizeof(location.dataSize));
+	}
 }
 
 HeaderOptions HeaderOptions::Deserialize (istream& inputStream)
@@ -51,7 +74,52 @@ HeaderOptions HeaderOptions::Deserialize (istream& inputStream)
 	inputStream.read((char*)&options._padWidth, sizeof(options._padWidth));
 	inputStream.read((char*)&options._padHeight, sizeof(options._padHeight));
 
+	// writers pad to whole 8x8 blocks; decoders size their planes by it
+	if (options._padWidth != ((uint64_t)options._width + 7) / 8 * 8 || options._padHeight != ((uint64_t)options._height + 7) / 8 * 8)
+		throw "Invalid PICTS padding.";
+
+	// decoders index their layer layouts & per-layer state by it
+	if (options._layerCount > MAX_LAYERS)
+		throw "Unsupported PICTS layer count.";
+
 	inputStream.read((char*)&options._quailty, sizeof(options._quailty));
 
+	// unversioned files are v1
+	options._version = 1;
+
+	if (flags & 0x10)
+	{
+		inputStream.read((char*)&options._version, sizeof(options._version));
+
+		if (options._version < 2 || options._version > PICTS_VERSION)
+			throw "Unsupported PICTS version.";
+
+		if (options._version >= 4)
+		{
+			uint8_t codingFlags = 0;
+			inputStream.read((char*)&codingFlags, sizeof(codingFlags));
+
+			if (codingFlags & ~PICTS_CODING_KNOWN)
+				throw "Unsupported PICTS coding.";
+
+			options._runLengthCoding = (codingFlags & PICTS_CODING_RUN_LENGTH) > 0;
+		}
+
+		for (uint8_t i = 0; i < options._layerCount; i++)
+		{
+			LayerLocation location;
+
+			inputStream.read((char*)&location.treeOffset, sizeof(location.treeOffset));
+			inputStream.read((char*)&location.treeSize, sizeof(location.treeSize));
+			inputStream.read((char*)&location.dataOffset, sizeof(location.dataOffset));
+			inputStream.read((char*)&location.dataSize, sizeof(location.dataSize));
+
+			options._layerTable.push_back(location);
+		}
+
+		if (!inputStream)
+			throw "File too short.";
+	}
+
 	return options;
 }
\ No newline at end of file
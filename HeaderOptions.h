@@ -3,15 +3,44 @@
 
 #include <iostream>
 #include <stdint.h>
+#include <vector>
 #include <opencv2/opencv.hpp>
 
 using namespace std;
 
+// format written by Serialize; v1 files have no version byte & no layer table
+//	v3: trees are canonical code lengths instead of value-weight pairs
+//	v4: a coding flags byte follows the version
+//	v5: a clear Huffman flag selects rANS layers (earlier files are Huffman coded either way)
+#define PICTS_VERSION 5
+
+// coding flags (v4+); readers reject any they don't know
+#define PICTS_CODING_RUN_LENGTH 0x01
+#define PICTS_CODING_KNOWN (PICTS_CODING_RUN_LENGTH)
+
+// every file holds three channels (BGR or YCrCb)
+#define PICTS_CHANNEL_COUNT 3
+
+// where one layer's tree & data live in the file (absolute byte offsets)
+struct LayerLocation
+{
+	uint64_t treeOffset;
+	uint32_t treeSize;
+
+	// layer byte count, value count & bits
+	uint64_t dataOffset;
+	uint32_t dataSize;
+};
+
 class HeaderOptions
 {
 	public:
+		HeaderOptions();
+
 		static HeaderOptions Deserialize (istream&);
 
+		// always writes the current version; the layer table is written as set (zeros if not),
+		//	so writers serialize again once the layers are written
 		void Serialize(ostream&);
 
 		uint32_t getWidth() { return _width; }
@@ -21,12 +50,26 @@ class HeaderOptions
 		uint32_t getPadHeight() { return _padHeight; }
 
 		bool getHuffmanCoding() { return _huffmanCoding; }
+		bool getRANSCoding() { return _version >= 5 && !_huffmanCoding; }
 		bool getSubtract128() { return _subtract128; }
 		bool getYUVColor() { return _yuvColor; }
 
+		// layers hold run-length symbols (see LayerBuffer.h) rather than counts & values
+		bool getRunLengthCoding() { return _runLengthCoding; }
+
+		uint8_t getChannelCount() { return PICTS_CHANNEL_COUNT; }
 		uint8_t getLayerCount() { return _layerCount; }
 		uint8_t getQuality() { return _quailty; }
 
+		uint8_t getVersion() { return _version; }
+
+		// v2+: layer locations, so readers can seek to any layer
+		bool hasLayerTable() { return _version >= 2; }
+		LayerLocation getLayerLocation(uint8_t layer) { return _layerTable.at(layer); }
+
+		// v3+: trees are stored as HuffmanCode lengths
+		bool hasCodeLengthTrees() { return _version >= 3; }
+
 		void setWidth(uint32_t width) { _width = width; }
 		void setHeight(uint32_t height) { _height = height; }
 
@@ -36,14 +79,25 @@ class HeaderOptions
 		void setYUVColor(bool yuvColor) { _yuvColor = yuvColor; }
 		void setSubtract128(bool subtract128) { _subtract128 = subtract128; }
 		void setHuffmanCoding(bool huffmanCoding) { _huffmanCoding = huffmanCoding; }
+		void setRunLengthCoding(bool runLengthCoding) { _runLengthCoding = runLengthCoding; }
 
 		void setLayerCount(uint8_t layerCount) { _layerCount = layerCount; }
 		void setQuality(uint8_t quailty) { _quailty = quailty; }
 
+		void setLayerLocation(uint8_t layer, LayerLocation location)
+		{
+			if (_layerTable.size() <= layer)
+				_layerTable.resize(layer + 1, LayerLocation { 0, 0, 0, 0 });
+
+			_layerTable[layer] = location;
+		}
+
 	private:
 		uint32_t _width, _height, _padWidth, _padHeight;
-		bool _yuvColor, _subtract128, _huffmanCoding;
-		uint8_t _layerCount, _quailty;
+		bool _yuvColor, _subtract128, _huffmanCoding, _runLengthCoding;
+		uint8_t _layerCount, _quailty, _version;
+
+		vector<LayerLocation> _layerTable;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,228 @@
+#include "HuffmanCode.h"
+
+#include <algorithm>
+#include <string.h>
+
+HuffmanCode::HuffmanCode()
+{
+	memset(_lengths, 0, sizeof(_lengths));
+	memset(_codes, 0, sizeof(_codes));
+}
+
+HuffmanCode HuffmanCode::FromLengths(const uint8_t* lengths, const bool* present)
+{
+	HuffmanCode code;
+
+	for (uint16_t value = 0; value < 256; value++)
+		if (present[value])
+		{
+			if (lengths[value] > HUFFMAN_MAX_CODE_LENGTH)
+				throw "Huffman code too long.";
+
+			code._lengths[value] = lengths[value];
+			code._symbols.push_back(value);
+		}
+
+	// shortest first, then by value
+	stable_sort(code._symbols.begin(), code._symbols.end(), [&](uint8_t a, uint8_t b) { return code._lengths[a] < code._lengths[b]; });
+
+	// a lone symbol takes no bits; otherwise every code needs at least one
+	if (code._symbols.size() == 1 && !code._lengths[code._symbols[0]])
+		return code;
+
+	uint64_t next = 0;
+	uint8_t length = 0;
+
+	for (uint8_t value : code._symbols)
+	{
+		if (!code._lengths[value])
+			throw "Invalid Huffman code lengths.";
+
+		next <<= code._lengths[value] - length;
+		length = code._lengths[value];
+
+		// over-subscribed: the lengths don't form a prefix code
+		if (next >> length)
+			throw "Invalid Huffman code lengths.";
+
+		code._codes[value] = next++;
+	}
+
+	return code;
+}
+
+HuffmanCode HuffmanCode::FromWeights(const map<int8_t, uint64_t>& valueWeightMap, uint8_t maxLength)
+{
+	uint8_t lengths[256] = { };
+	bool present[256] = { };
+
+	// leaves, lightest first
+	vector<pair<uint64_t, uint8_t>> leaves;
+	for (auto valueWeight : valueWeightMap)
+	{
+		leaves.push_back(make_pair(valueWeight.second, (uint8_t)valueWeight.first));
+		present[(uint8_t)valueWeight.first] = true;
+	}
+
+	sort(leaves.begin(), leaves.end());
+	size_t leafCount = leaves.size();
+
+	// a lone symbol takes no bits
+	if (leafCount < 2)
+		return FromLengths(lengths, present);
+
+	if (maxLength > HUFFMAN_MAX_CODE_LENGTH || (1ull << maxLength) < leafCount)
+		throw "Invalid Huffman code length limit.";
+
+	/*
+		package-merge: level 1 is the leaves; each deeper level merges the leaves with
+		pairs (packages) of the level above. the lightest 2n - 2 items of the last level
+		are the optimal code; a leaf's length is the number of selected items holding it
+
+		selected items are always a prefix of their level, & the packages in it are made
+		from a prefix of the level above, so only each level's leaf / package order is kept
+	*/
+	vector<vector<bool>> isLeaf(maxLength);
+	vector<uint64_t> items, merged;
+
+	for (auto leaf : leaves)
+		items.push_back(leaf.first);
+
+	isLeaf[0].assign(leafCount, true);
+
+	for (uint8_t level = 1; level < maxLength; level++)
+	{
+		merged.clear();
+		size_t leaf = 0, package = 0;
+
+		while (leaf < leafCount || package + 1 < items.size())
+		{
+			uint64_t packageWeight = package + 1 < items.size() ? items[package] + items[package + 1] : 0;
+
+			// leaves win ties
+			if (leaf < leafCount && (package + 1 >= items.size() || leaves[leaf].first <= packageWeight))
+			{
+				merged.push_back(leaves[leaf++].first);
+				isLeaf[level].push_back(true);
+			}
+			else
+			{
+				merged.push_back(packageWeight);
+				isLeaf[level].push_back(false);
+				package += 2;
+			}
+		}
+
+		items.swap(merged);
+	}
+
+	// walk back up: the selected prefix's leaves lengthen; its packages select from the level above
+	size_t selected = 2 * leafCount - 2;
+
+	for (int level = maxLength - 1; level >= 0 && selected; level--)
+	{
+		size_t leaf = 0, packages = 0;
+
+		for (size_t i = 0; i < selected; i++)
+			isLeaf[level][i] ? leaf++ : packages++;
+
+		for (size_t i = 0; i < leaf; i++)
+			lengths[leaves[i].second]++;
+
+		selected = packages * 2;
+	}
+
+	return FromLengths(lengths, present);
+}
+
+HuffmanCode HuffmanCode::FromTree(const HuffmanNodeArray& tree)
+{
+	uint8_t lengths[256] = { };
+	bool present[256] = { };
+
+	tree.forEachLeaf([&](int8_t value, uint32_t /*code*/, uint8_t depth)
+	{
+		lengths[(uint8_t)value] = depth;
+		present[(uint8_t)value] = true;
+	});
+
+	return FromLengths(lengths, present);
+}
+
+uint64_t HuffmanCode::Serialize(ostream& outputStream)
+{
+	uint16_t symbolCount = _symbols.size();
+	uint8_t maxLength = getMaxLength();
+
+	outputStream.write(reinterpret_cast<const char*>(&symbolCount), sizeof(symbolCount));
+
+	if (!symbolCount)
+		return sizeof(symbolCount);
+
+	outputStream.write(reinterpret_cast<const char*>(&maxLength), sizeof(maxLength));
+
+	uint8_t counts[HUFFMAN_MAX_CODE_LENGTH + 1] = { };
+	for (uint8_t value : _symbols)
+		counts[_lengths[value]]++;
+
+	// the longest length's count is implied; it's the only one that can reach 256
+	for (uint8_t length = 1; length < maxLength; length++)
+		outputStream.write(reinterpret_cast<const char*>(&counts[length]), sizeof(counts[length]));
+
+	outputStream.write(reinterpret_cast<const char*>(_symbols.data()), symbolCount);
+
+	return sizeof(symbolCount) + sizeof(maxLength) + (maxLength ? maxLength - 1 : 0) + symbolCount;
+}
+
+HuffmanCode HuffmanCode::Deserialize(istream& inputStream)
+{
+	uint16_t symbolCount = 0;
+	inputStream.read(reinterpret_cast<char*>(&symbolCount), sizeof(symbolCount));
+
+	if (!symbolCount)
+		return HuffmanCode();
+
+	uint8_t maxLength = 0;
+	inputStream.read(reinterpret_cast<char*>(&maxLength), sizeof(maxLength));
+
+	if (symbolCount > 256 || maxLength > HUFFMAN_MAX_CODE_LENGTH || (!maxLength && symbolCount != 1))
+		throw "Invalid Huffman code lengths.";
+
+	uint16_t counts[HUFFMAN_MAX_CODE_LENGTH + 1] = { }, assigned = 0;
+
+	for (uint8_t length = 1; length < maxLength; length++)
+	{
+		uint8_t count = 0;
+		inputStream.read(reinterpret_cast<char*>(&count), sizeof(count));
+
+		counts[length] = count;
+		assigned += count;
+	}
+
+	if (assigned >= symbolCount && maxLength)
+		throw "Invalid Huffman code lengths.";
+
+	counts[maxLength] = symbolCount - assigned;
+
+	vector<uint8_t> symbols(symbolCount);
+	inputStream.read(reinterpret_cast<char*>(symbols.data()), symbolCount);
+
+	if (!inputStream)
+		throw "File too short.";
+
+	uint8_t lengths[256] = { };
+	bool present[256] = { };
+	uint16_t symbol = 0;
+
+	for (uint8_t length = 0; length <= maxLength; length++)
+		for (uint16_t i = 0; i < counts[length]; i++, symbol++)
+		{
+			if (present[symbols[symbol]])
+				throw "Invalid Huffman code lengths.";
+
+			lengths[symbols[symbol]] = length;
+			present[symbols[symbol]] = true;
+		}
+
+	return FromLengths(lengths, present);
+}
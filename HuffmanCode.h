@@ -0,0 +1,62 @@
+#ifndef HuffmanCode_h
+#define HuffmanCode_h
+
+#include <iostream>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+#include "HuffmanNodeArray.h"
+#include "HuffmanDecoder.h"
+
+// encoder's cap on code lengths; codes this short decode with a single table probe
+#define HUFFMAN_DEFAULT_MAX_LENGTH HUFFMAN_LOOKUP_BITS
+
+using namespace std;
+
+/*
+	canonical prefix code over the 256 byte values
+
+	only the code lengths are stored; codes are assigned shortest first, then by value
+	(as DEFLATE & JPEG DHT), so lengths alone rebuild the code
+
+	serialized (v3+):
+		uint16 symbol count
+		uint8 longest length; 0 when there is a single symbol, which takes no bits
+		uint8 count of symbols with length 1 .. longest - 1; the longest length has the rest
+		uint8 symbols, in code order
+*/
+class HuffmanCode
+{
+	public:
+		HuffmanCode();
+
+		// lengths indexed by (uint8_t)value; present marks the values in the code
+		static HuffmanCode FromLengths(const uint8_t*, const bool*);
+
+		// optimal lengths no longer than maxLength (package-merge)
+		static HuffmanCode FromWeights(const map<int8_t, uint64_t>&, uint8_t);
+
+		// lengths of a tree's leaves (the depth bit-by-bit decoding stops at)
+		static HuffmanCode FromTree(const HuffmanNodeArray&);
+
+		static HuffmanCode Deserialize(istream&);
+
+		// returns serialized length
+		uint64_t Serialize(ostream&);
+
+		uint32_t getCode(uint8_t value) { return _codes[value]; }
+		uint8_t getLength(uint8_t value) { return _lengths[value]; }
+
+		// values in code order
+		const vector<uint8_t>& getSymbols() { return _symbols; }
+		uint8_t getMaxLength() { return _symbols.empty() ? 0 : _lengths[_symbols.back()]; }
+
+	private:
+		uint8_t _lengths[256];
+		uint32_t _codes[256];
+
+		vector<uint8_t> _symbols;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#include "HuffmanDecoder.h"
+#include "HuffmanCode.h"
+
+#include <algorithm>
+
+HuffmanDecoder::HuffmanDecoder(const HuffmanNodeArray& tree)
+{
+	// value, code, length
+	vector<tuple<int8_t, uint32_t, uint8_t>> codes;
+
+	tree.forEachLeaf([&](int8_t value, uint32_t code, uint8_t depth)
+	{
+		codes.push_back(make_tuple(value, code, depth));
+	});
+
+	_build(codes);
+}
+
+HuffmanDecoder::HuffmanDecoder(HuffmanCode& code)
+{
+	vector<tuple<int8_t, uint32_t, uint8_t>> codes;
+
+	for (uint8_t value : code.getSymbols())
+		codes.push_back(make_tuple((int8_t)value, code.getCode(value), code.getLength(value)));
+
+	_build(codes);
+}
+
+void HuffmanDecoder::_build(const vector<tuple<int8_t, uint32_t, uint8_t>>& codes)
+{
+	_maxLength = 0;
+	for (auto code : codes)
+		_maxLength = max(_maxLength, get<2>(code));
+
+	if (_maxLength > HUFFMAN_MAX_CODE_LENGTH)
+		throw "Huffman code too long.";
+
+	_primaryBits = min(_maxLength, (uint8_t)HUFFMAN_LOOKUP_BITS);
+	_subtableBits = _maxLength - _primaryBits;
+
+	_table.resize(1u << _primaryBits, Entry { 0, 0, false, 0 });
+
+	for (auto code : codes)
+	{
+		int8_t value = get<0>(code);
+		uint32_t bits = get<1>(code);
+		uint8_t length = get<2>(code);
+
+		if (length <= _primaryBits)
+		{
+			// short code: fill every primary slot that starts with it
+			uint32_t first = bits << (_primaryBits - length),
+					 count = 1u << (_primaryBits - length);
+
+			for (uint32_t i = 0; i < count; i++)
+				_table[first + i] = Entry { value, length, false, 0 };
+
+			continue;
+		}
+
+		// long code: primary slot links to a subtable indexed by the remaining bits
+		uint32_t prefix = bits >> (length - _primaryBits);
+
+		if (!_table[prefix].link)
+		{
+			uint32_t next = _table.size();
+			_table[prefix] = Entry { 0, 0, true, next };
+			_table.resize(next + (1u << _subtableBits), Entry { 0, 0, false, 0 });
+		}
+
+		uint32_t next = _table[prefix].next,
+				 remainder = bits & ((1u << (length - _primaryBits)) - 1),
+				 first = remainder << (_maxLength - length),
+				 count = 1u << (_maxLength - length);
+
+		for (uint32_t i = 0; i < count; i++)
+			_table[next + first + i] = Entry { value, length, false, 0 };
+	}
+}
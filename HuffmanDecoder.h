@@ -0,0 +1,57 @@
+#ifndef HuffmanDecoder_h
+#define HuffmanDecoder_h
+
+#include <vector>
+
+#include "HuffmanNodeArray.h"
+#include "ifbitstream.h"
+
+class HuffmanCode;
+
+using namespace std;
+
+// codes up to this length resolve with a single table probe
+#define HUFFMAN_LOOKUP_BITS 12
+#define HUFFMAN_MAX_CODE_LENGTH 24
+
+class HuffmanDecoder
+{
+	public:
+		HuffmanDecoder(const HuffmanNodeArray&);
+
+		// straight from code lengths; no pointer tree
+		HuffmanDecoder(HuffmanCode&);
+
+		int8_t Decode(ifbitstream& inputStream)
+		{
+			uint32_t bits = inputStream.peek(_maxLength);
+			const Entry* entry = &_table[bits >> _subtableBits];
+
+			// codes longer than the lookup width continue in a subtable
+			if (entry->link)
+				entry = &_table[entry->next + (bits & ((1u << _subtableBits) - 1))];
+
+			inputStream.consume(entry->length);
+
+			return entry->value;
+		}
+
+		uint8_t getMaxLength() { return _maxLength; }
+
+	private:
+		struct Entry
+		{
+			int8_t value;
+			uint8_t length;
+			bool link;
+			uint32_t next;
+		};
+
+		// value, code, length
+		void _build(const vector<tuple<int8_t, uint32_t, uint8_t>>&);
+
+		uint8_t _maxLength, _primaryBits, _subtableBits;
+		vector<Entry> _table;
+};
+
+#endif
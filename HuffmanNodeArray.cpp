@@ -0,0 +1,40 @@
+#include "HuffmanNodeArray.h"
+
+uint16_t HuffmanNodeArray::addLeaf(uint64_t weight, int8_t value)
+{
+	_nodes.push_back(HuffmanTreeNode { weight, value, { HUFFMAN_NO_NODE, HUFFMAN_NO_NODE } });
+	return _nodes.size() - 1;
+}
+
+uint16_t HuffmanNodeArray::addParent(uint16_t node0, uint16_t node1)
+{
+	_nodes.push_back(HuffmanTreeNode { _nodes[node0].weight + _nodes[node1].weight, 0, { node0, node1 } });
+	return _nodes.size() - 1;
+}
+
+ostream& operator<< (ostream& os, const HuffmanNodeArray& nodes)
+{
+	if (!nodes.empty())
+		nodes._print(os, nodes.getRoot());
+
+	return os;
+}
+
+void HuffmanNodeArray::_print(ostream& os, uint16_t node) const
+{
+	os << "[ w: " << _nodes[node].weight << "; v: " << (int)_nodes[node].value << " ]";
+
+	if (_nodes[node].child[0] != HUFFMAN_NO_NODE)
+	{
+		os << " 0: (";
+		_print(os, _nodes[node].child[0]);
+		os << ")";
+	}
+
+	if (_nodes[node].child[1] != HUFFMAN_NO_NODE)
+	{
+		os << " 1: (";
+		_print(os, _nodes[node].child[1]);
+		os << ")";
+	}
+}
@@ -0,0 +1,78 @@
+#ifndef HuffmanNodeArray_h
+#define HuffmanNodeArray_h
+
+#include <iostream>
+#include <stdint.h>
+#include <vector>
+
+using namespace std;
+
+// child index of a leaf
+#define HUFFMAN_NO_NODE 0xffff
+
+struct HuffmanTreeNode
+{
+	uint64_t weight;
+	int8_t value;
+
+	// indices into the node array
+	uint16_t child[2];
+};
+
+/*
+	a Huffman tree as one array of nodes linked by index; 256 values need at most 511 nodes
+
+	children are added before their parent, so the root is the last node
+*/
+class HuffmanNodeArray
+{
+	public:
+		uint16_t addLeaf(uint64_t weight, int8_t value);
+		uint16_t addParent(uint16_t node0, uint16_t node1);
+
+		const HuffmanTreeNode& at(uint16_t node) const { return _nodes[node]; }
+
+		// the bit-by-bit decoder stopped at any node without both children
+		bool isLeaf(uint16_t node) const { return _nodes[node].child[0] == HUFFMAN_NO_NODE || _nodes[node].child[1] == HUFFMAN_NO_NODE; }
+
+		bool empty() const { return _nodes.empty(); }
+		uint16_t getRoot() const { return _nodes.size() - 1; }
+
+		// visits every leaf with its code & depth, 0 branch first
+		template <typename F>
+		void forEachLeaf(F function) const
+		{
+			if (empty())
+				return;
+
+			// node, code, depth; depth never exceeds the node count
+			struct Pending { uint16_t node; uint32_t code; uint8_t depth; } stack[256];
+			uint16_t top = 0;
+
+			stack[top++] = Pending { getRoot(), 0, 0 };
+
+			while (top)
+			{
+				Pending current = stack[--top];
+				const HuffmanTreeNode& node = _nodes[current.node];
+
+				if (isLeaf(current.node))
+				{
+					function(node.value, current.code, current.depth);
+					continue;
+				}
+
+				stack[top++] = Pending { node.child[1], current.code << 1 | 1, (uint8_t)(current.depth + 1) };
+				stack[top++] = Pending { node.child[0], current.code << 1 | 0, (uint8_t)(current.depth + 1) };
+			}
+		}
+
+		friend ostream& operator<< (ostream&, const HuffmanNodeArray&);
+
+	private:
+		void _print(ostream&, uint16_t) const;
+
+		vector<HuffmanTreeNode> _nodes;
+};
+
+#endif
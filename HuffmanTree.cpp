@@ -1,20 +1,38 @@
 #include "HuffmanTree.h"
+#include "HuffmanDecoder.h"
+#include "WorkerPool.h"
+#include "Instrumentation.h"
+#include "MappedFile.h"
 
 #include <algorithm>
+#include <memory>
+#include <string.h>
 #include <assert.h>
 
 HuffmanTree::HuffmanTree(uint8_t layerCount)
 {
 	assert(layerCount <= MAX_LAYERS);
 	_layerCount = layerCount;
+	_version = PICTS_VERSION;
+	_runLength = false;
+	_rans = false;
+	_layout = NULL;
+	_blockCount = 0;
 }
 
-HuffmanTree::~HuffmanTree()
+void HuffmanTree::_setHeader(HeaderOptions& header)
 {
-	for (HuffmanTreeNode* node : _roots)
-		delete node;
+	_version = header.getVersion();
+	_runLength = header.getRunLengthCoding();
+	_rans = header.getRANSCoding();
+
+	_layout = &ZigzagLayouts[header.getLayerCount()];
+	_blockCount = (size_t)header.getChannelCount() * (header.getPadWidth() / 8) * (header.getPadHeight() / 8);
+}
 
-	for (list<uint8_t>* layer : _layerData)
+HuffmanTree::~HuffmanTree()
+{
+	for (LayerBuffer* layer : _layerData)
 		delete layer;
 	
 	for (map<int8_t, uint64_t>* valueWeightMap : _valueWeightMaps)
@@ -22,6 +40,11 @@ HuffmanTree::~HuffmanTree()
 }
 
 HuffmanTree* HuffmanTree::FromImage(Mat* inputImage, uint8_t layerCount)
+{
+	return FromImage(inputImage, layerCount, false);
+}
+
+HuffmanTree* HuffmanTree::FromImage(Mat* inputImage, uint8_t layerCount, bool runLength)
 {
 	// max of 8 layers
 	assert(layerCount <= 8);
@@ -88,207 +111,160 @@ HuffmanTree* HuffmanTree::FromImage(Mat* inputImage, uint8_t layerCount)
 	split(*inputImage, channels);
 	uint8_t channelCount = inputImage->channels();
 
-	vector<uint8_t> elementCounts;
-	map<uint8_t, vector<uint8_t>> currentLayerData;
+	const ZigzagLayout& layout = ZigzagLayouts[layerCount];
 	HuffmanTree *tree = new HuffmanTree(layerCount);
+	tree->_runLength = runLength;
+	size_t blockCount = (size_t)channelCount * (width / 8) * (height / 8);
 
+	// at most a count & every value of the layer per block
 	for (uint8_t i = 0; i < layerCount; i++)
-	{
-		elementCounts.push_back(0);
-
-		list<uint8_t> *layer = new list<uint8_t>();
-
-		tree->_layerData.push_back(layer);
-
-		vector<uint8_t> currentLayer;
-		currentLayerData[i] = currentLayer;
-
-		map<int8_t, uint64_t> *layerByteCount = new map<int8_t, uint64_t>;
-		tree->_valueWeightMaps.push_back(layerByteCount);
-	}
+		tree->_layerData.push_back(new LayerBuffer(blockCount * _blockCapacity(layout.layerSize(i), runLength)));
 
 	// cout << "block count: " << (((width / 8) * (height / 8)) * 3) << endl;
 
+	int8_t zigzag[64];
+
 	for (uint8_t i = 0; i < channelCount; i++)
 	{
 		Mat currentChannel = channels[i];
 		for (uint32_t j = 0; j < width; j += 8)
 			for (uint32_t k = 0; k < height; k+= 8)
 			{
-				Mat currentBlock = currentChannel(Rect(j, k, 8, 8));
-				
-				// zig-zag traverse matrix
-				ZigzagMatProcessor(&currentBlock, layerCount, [&](int8_t* value, uint8_t index, uint8_t layer, uint8_t layerIndex)
-				{
-					uint8_t layerI = layer - 1;
-
-					// save last non-zero value index
-					if (*value)
-						elementCounts[layerI] = layerIndex + 1;
-					
-					// create list of values for each layer
-					currentLayerData[layerI].push_back(*value);
-
-					return true;
-				});
-
-				// layer 0 has no count - always one element
-				// layer 1..(n - 1) have n elements
-				// layer n has all other elements - almost certain to have trailing-zero values
+				// zig-zag traverse block
+				ZigzagGather(currentChannel.ptr<int8_t>(k) + j, currentChannel.step, layout, zigzag);
+
 				for (uint8_t l = 0; l < layerCount; l++)
-				{
-					// if (!i && !j && !k)
-					// 	cout << "layer: " << (int)l << "; elementCount: " << (int)elementCounts[l] << endl;
-
-					map<int8_t, uint64_t> *valueWeightMap = tree->_valueWeightMaps[l];
-
-					// other layers
-					//	add size
-					int8_t value = elementCounts[l];
-					tree->_layerData[l]->push_back(value);
-					((*valueWeightMap)[value])++;
-
-					// add values to count
-					while (elementCounts[l]-- > 0)
-					{
-						value = currentLayerData[l].front();
-						tree->_layerData[l]->push_back(value);
-						currentLayerData[l].erase(currentLayerData[l].begin());
-						((*valueWeightMap)[value])++;
-					}
-
-					// empty queue
-					currentLayerData[l].clear();
-					elementCounts[l] = 0;
-				}
+					_encodeLayer(&zigzag[layout.layerStart[l]], layout.layerSize(l), *tree->_layerData[l], runLength);
 			}
 	}
 
-	// create trees from weight maps
 	for (uint8_t l = 0; l < layerCount; l++)
-		tree->_roots.push_back(_treeFromValueWeightMap(tree->_valueWeightMaps[l]));
+		tree->_valueWeightMaps.push_back(_valueWeightMapFromLayer(*tree->_layerData[l], runLength));
+
+	// create codes from weight maps
+	for (uint8_t l = 0; l < layerCount; l++)
+	{
+		tree->_trees.push_back(HuffmanNodeArray());
+		tree->_codes.push_back(HuffmanCode::FromWeights(*tree->_valueWeightMaps[l], HUFFMAN_DEFAULT_MAX_LENGTH));
+		tree->_ransCodes.push_back(RansCode::FromWeights(*tree->_valueWeightMaps[l]));
+	}
 
 	return tree;
 }
 
-HuffmanTreeNode* HuffmanTree::_treeFromValueWeightMap(map<int8_t, uint64_t> *valueWeightMap)
+void HuffmanTree::_encodeLayer(const int8_t* values, uint8_t layerSize, LayerBuffer& layerData, bool runLength)
 {
-	/// cout << "\033[1;31mHuffmanTree::_treeFromValueWeightMap\033[0m" << endl;
-	
-	// create HuffmanTreeNodes & push values to vector
-	vector<HuffmanTreeNode*> nodes;
-	for (pair<int8_t, uint64_t> valueWeight : *valueWeightMap)
-	{
-		HuffmanTreeNode *node = new HuffmanTreeNode(valueWeight.second, valueWeight.first);
-		nodes.push_back(node);
-	}
-
-	// sort vector
-	sort(nodes.begin(), nodes.end(), [](HuffmanTreeNode* a, HuffmanTreeNode* b) { return a->getWeight() < b->getWeight(); });
+	// count up to & including the last non-zero value, then the values
+	//	layer 0 is a single value (a 0 count doubles as a 0 value; see ToImage)
+	uint8_t elementCount = layerSize;
+	while (elementCount && !values[elementCount - 1])
+		elementCount--;
 
-	while (nodes.size() > 1)
+	if (runLength)
 	{
-		vector<HuffmanTreeNode*> combinedNodes;
+		// (zero run, value bits) symbols, each followed by its value; as JPEG's AC coefficients
+		uint8_t run = 0;
 
-		while (nodes.size() >= 1)
-			switch (nodes.size())
+		for (uint8_t e = 0; e < elementCount; e++)
+		{
+			if (!values[e])
 			{
-				case 1:
-					// only one left
-					combinedNodes.push_back(nodes.at(0));
-					nodes.erase(nodes.begin());
-					break;
-				default:
-					HuffmanTreeNode *node0 = nodes.at(0),
-									*node1 = nodes.at(1),
-									*nodeP = new HuffmanTreeNode(node0->getWeight() + node1->getWeight(), 0, node0, node1);
-					
-					nodes.erase(nodes.begin());
-					nodes.erase(nodes.begin());
-					combinedNodes.push_back(nodeP);
-					break;
+				run++;
+				continue;
 			}
 
-		nodes = combinedNodes;
+			for (; run > 15; run -= 16)
+				layerData.push(LAYER_RUN_ZRL);
+
+			int magnitude = abs(values[e]);
+			uint8_t bits = 32 - __builtin_clz(magnitude);
+
+			layerData.push(run << 4 | bits);
+			layerData.push(values[e]);
+			run = 0;
+		}
+
+		// a block that fills its layer needs no EOB
+		if (elementCount < layerSize)
+			layerData.push(LAYER_RUN_EOB);
+
+		return;
 	}
 
-	return nodes.at(0);
+	layerData.push(elementCount);
+
+	for (uint8_t e = 0; e < elementCount; e++)
+		layerData.push(values[e]);
 }
 
-map<uchar, tuple<uchar, uchar>> HuffmanTree::Traverse(HuffmanTreeNode* baseNode)
+map<int8_t, uint64_t>* HuffmanTree::_valueWeightMapFromLayer(const LayerBuffer& layerData, bool runLength)
 {
-	return Traverse(0, 0, baseNode);
+	uint64_t weights[256] = { };
+
+	if (!runLength)
+		for (uint8_t value : layerData)
+			weights[value]++;
+	else
+		for (const uint8_t* symbol = layerData.begin(); symbol < layerData.end(); symbol++)
+		{
+			weights[*symbol]++;
+
+			// skip the value
+			if (*symbol & 0x0f)
+				symbol++;
+		}
+
+	map<int8_t, uint64_t> *valueWeightMap = new map<int8_t, uint64_t>;
+
+	for (uint16_t value = 0; value < 256; value++)
+		if (weights[value])
+			(*valueWeightMap)[(int8_t)value] = weights[value];
+
+	return valueWeightMap;
 }
 
-map<uchar, tuple<uchar, uchar>> HuffmanTree::Traverse(int8_t value, uchar depth, HuffmanTreeNode* baseNode)
+// v1 / v2 trees: sorted nodes merged pairwise, pass by pass (not a true Huffman tree)
+HuffmanNodeArray HuffmanTree::_treeFromValueWeightMap(map<int8_t, uint64_t> *valueWeightMap)
 {
-	assert(baseNode != NULL);
+	/// cout << "\033[1;31mHuffmanTree::_treeFromValueWeightMap\033[0m" << endl;
+	
+	// create leaves & push their indices to vector
+	HuffmanNodeArray tree;
+	vector<uint16_t> nodes;
+	for (pair<int8_t, uint64_t> valueWeight : *valueWeightMap)
+		nodes.push_back(tree.addLeaf(valueWeight.second, valueWeight.first));
 
-	bool leaf = true;
-	map <uchar, tuple<uchar, uchar>> values;
+	// sort vector
+	sort(nodes.begin(), nodes.end(), [&](uint16_t a, uint16_t b) { return tree.at(a).weight < tree.at(b).weight; });
 
-	// traverse left node
-	if (baseNode->get0())
+	while (nodes.size() > 1)
 	{
-		map <uchar, tuple<uchar, uchar>> values0 = Traverse(value << 1 | 0, depth + 1, baseNode->get0());
-		values.insert(values0.begin(), values0.end());
+		vector<uint16_t> combinedNodes;
 
-		leaf = false;
-	}
-	
-	// traverse right node
-	if (baseNode->get1())
-	{
-		map <uchar, tuple<uchar, uchar>> values1 = Traverse(value << 1 | 1, depth + 1, baseNode->get1());
-		values.insert(values1.begin(), values1.end());
+		// pair neighbours; an odd one out carries over
+		for (size_t i = 0; i < nodes.size(); i += 2)
+			combinedNodes.push_back(i + 1 < nodes.size() ? tree.addParent(nodes[i], nodes[i + 1]) : nodes[i]);
 
-		leaf = false;
+		nodes = combinedNodes;
 	}
 
-	// if this is a leaf, add it to the value list
-	if (leaf)
-		values[baseNode->getValue()] = make_tuple(value, depth);
-
-	return values;
+	return tree;
 }
 
 uint64_t HuffmanTree::SerializeTree (ostream& outputStream, uint8_t layer)
 {
 	/// cout << "\033[1;31mHuffmanTree::SerializeTree: " << (int)layer << "\033[0m" << endl;
-    
-	// value, weight
-	vector<uchar> tree;
-	int sizeofFirst = sizeof(uchar),
-		sizeofSecond = sizeof(uint64_t),
-		recordSize = sizeofFirst + sizeofSecond;
-	
-	map<int8_t, uint64_t> *valueWeightMap = _valueWeightMaps[layer];
-	uint32_t entryCount = valueWeightMap->size();
 
-	// cout << "SerializeTree: entryCount[" << (int)layer << "]: " << entryCount << endl;
-	
-	// save tree size
-	outputStream.write(reinterpret_cast<const char*>(&entryCount), sizeof(entryCount));
-
-	// save items
-	for (auto valueWeight : *valueWeightMap)
-	{
-		outputStream.write(reinterpret_cast<const char*>(&valueWeight.first), sizeofFirst);
-		outputStream.write(reinterpret_cast<const char*>(&valueWeight.second), sizeofSecond);
-	}
-
-	return entryCount * 9;
+	return _rans ? _ransCodes[layer].Serialize(outputStream) : _codes[layer].Serialize(outputStream);
 }
 
-HuffmanTreeNode* HuffmanTree::DeserializeTree (ifbitstream& inputStream, map<int8_t, uint64_t> *valueWeightMap)
+HuffmanNodeArray HuffmanTree::DeserializeTree (ifbitstream& inputStream, map<int8_t, uint64_t> *valueWeightMap)
 {
 	/// cout << "\033[1;31mHuffmanTree::DeserializeTree\033[0m" << endl;
 	
+	map<int8_t, uint64_t> tempValueWeightMap;
 	if (!valueWeightMap)
-	{
-		map<int8_t, uint64_t> tempValueWeightMap;
 		valueWeightMap = &tempValueWeightMap;
-	}
 		
 	// read entry count
 	uint32_t entryCount = 0;
@@ -316,15 +292,99 @@ HuffmanTreeNode* HuffmanTree::DeserializeTree (ifbitstream& inputStream, map<int
 HuffmanTree* HuffmanTree::Deserialize (ifbitstream& inputStream, HeaderOptions& header)
 {
 	/// cout << "\033[1;31mHuffmanTree::Deserialize\033[0m" << endl;
+	PICTS_STAGE("decode.deserialize");
 	
-	HuffmanTree* tree = new HuffmanTree(0);
+	// released once every layer is read
+	unique_ptr<HuffmanTree> tree(new HuffmanTree(0));
+	tree->_setHeader(header);
 	// HuffmanTree* tree = new HuffmanTree(header.getLayerCount());
 
 	// read-in each layer
 	for (uint8_t i = 0; i < header.getLayerCount() && !inputStream.eof(); i++)
-		AddLayer(inputStream, tree);
+		AddLayer(inputStream, tree.get());
 
-	return tree;
+	return tree.release();
+}
+
+HuffmanTree* HuffmanTree::Deserialize (string filePath, HeaderOptions& header, unsigned threadCount)
+{
+	return Deserialize(filePath, header, 0, threadCount);
+}
+
+HuffmanTree* HuffmanTree::Deserialize (string filePath, HeaderOptions& header, uint8_t maxLayer, unsigned threadCount)
+{
+	MappedFile file(filePath);
+
+	return Deserialize(file.data(), file.size(), header, maxLayer, threadCount);
+}
+
+HuffmanTree* HuffmanTree::Deserialize (const uint8_t* data, size_t size, HeaderOptions& header, unsigned threadCount)
+{
+	return Deserialize(data, size, header, 0, threadCount);
+}
+
+HuffmanTree* HuffmanTree::Deserialize (const uint8_t* data, size_t size, HeaderOptions& header, uint8_t maxLayer, unsigned threadCount)
+{
+	PICTS_STAGE("decode.deserialize");
+
+	ifbitstream inputStream(data, size);
+	header = HeaderOptions::Deserialize(inputStream);
+
+	if (!maxLayer)
+		maxLayer = header.getLayerCount();
+	else
+		maxLayer = min(maxLayer, header.getLayerCount());
+
+	vector<streamoff> layerOffsets;
+
+	// v2+ lists every layer's location
+	if (header.hasLayerTable())
+		for (uint8_t i = 0; i < maxLayer; i++)
+			layerOffsets.push_back(header.getLayerLocation(i).treeOffset);
+
+	// v1: walk the layer lengths to find where each layer starts
+	for (uint8_t i = layerOffsets.size(); i < maxLayer; i++)
+	{
+		streamoff layerOffset = inputStream.tellg();
+		uint32_t entryCount = 0, layerBytes = 0;
+
+		// DeserializeTree reads at most 256 entries
+		inputStream.read(reinterpret_cast<char*>(&entryCount), sizeof(entryCount));
+		inputStream.seekg(min(entryCount, 256u) * (sizeof(int8_t) + sizeof(uint64_t)), ios::cur);
+
+		// layerBytes covers the value count & the bits
+		inputStream.read(reinterpret_cast<char*>(&layerBytes), sizeof(layerBytes));
+		inputStream.seekg(layerBytes, ios::cur);
+
+		if (!inputStream)
+			break;
+
+		layerOffsets.push_back(layerOffset);
+	}
+
+	// each layer decodes from its own stream over the same bytes; released once every layer is read
+	unique_ptr<HuffmanTree> tree(new HuffmanTree(layerOffsets.size()));
+	tree->_setHeader(header);
+	tree->_trees.resize(layerOffsets.size());
+	tree->_codes.resize(layerOffsets.size());
+	tree->_ransCodes.resize(layerOffsets.size());
+	tree->_layerData.resize(layerOffsets.size());
+
+	for (size_t i = 0; i < layerOffsets.size(); i++)
+		tree->_valueWeightMaps.push_back(new map<int8_t, uint64_t>());
+
+	WorkerPool::Run(layerOffsets.size(), threadCount, [&](uint32_t i)
+	{
+		ifbitstream layerStream(data, size);
+		layerStream.seekg(layerOffsets[i]);
+
+		tree->_readLayer(layerStream, i);
+	});
+
+	for (size_t i = 0; i < layerOffsets.size(); i++)
+		PICTS_COUNT_LAYER(i, "decoded_symbols", tree->_layerData[i]->size());
+
+	return tree.release();
 }
 
 uint8_t HuffmanTree::AddLayer(ifbitstream& inputStream)
@@ -336,18 +396,52 @@ uint8_t HuffmanTree::AddLayer(ifbitstream& inputStream, HuffmanTree* tree)
 {
 	/// cout << "\033[1;31mHuffmanTree::AddLayer\033[0m" << endl;
 
-	map<int8_t, uint64_t> *valueWeightMap = new map<int8_t, uint64_t>();
-	HuffmanTreeNode* root = DeserializeTree(inputStream, valueWeightMap);
-	tree->_roots.push_back(_treeFromValueWeightMap(valueWeightMap));
+	if (tree->_layerCount >= MAX_LAYERS)
+		throw "No more layers to add.";
 
-	tree->_valueWeightMaps. push_back(valueWeightMap);
+	tree->_trees.push_back(HuffmanNodeArray());
+	tree->_codes.push_back(HuffmanCode());
+	tree->_ransCodes.push_back(RansCode());
+	tree->_valueWeightMaps.push_back(new map<int8_t, uint64_t>());
+	tree->_layerData.push_back(NULL);
 
-	list<uint8_t> *layerData = DeserializeLayer(inputStream, root);
-	tree->_layerData.push_back(layerData);
+	tree->_readLayer(inputStream, tree->_layerCount);
 
 	return ++tree->_layerCount;
 }
 
+void HuffmanTree::_readLayer(ifbitstream& inputStream, uint8_t layer)
+{
+	// every block's most symbols; a corrupt count can't allocate more
+	size_t capacity = _layout ? _blockCount * _blockCapacity(_layout->layerSize(layer), _runLength) : SIZE_MAX;
+
+	if (_rans)
+	{
+		_ransCodes[layer] = RansCode::Deserialize(inputStream);
+		_layerData[layer] = DeserializeLayer(inputStream, _ransCodes[layer], _runLength, capacity);
+
+		return;
+	}
+
+	if (_version >= 3)
+	{
+		// the decoder's tables come straight from the code lengths
+		_codes[layer] = HuffmanCode::Deserialize(inputStream);
+
+		HuffmanDecoder decoder(_codes[layer]);
+		_layerData[layer] = DeserializeLayer(inputStream, decoder, _runLength, capacity);
+
+		return;
+	}
+
+	// v1 / v2 bits follow the rebuilt tree's own codes; the canonical code is kept for re-serializing
+	_trees[layer] = DeserializeTree(inputStream, _valueWeightMaps[layer]);
+	_codes[layer] = HuffmanCode::FromTree(_trees[layer]);
+
+	HuffmanDecoder decoder(_trees[layer]);
+	_layerData[layer] = DeserializeLayer(inputStream, decoder, false, capacity);
+}
+
 Mat* HuffmanTree::ToImage(HeaderOptions& header)
 {
 	return ToImage(header, 0);
@@ -355,6 +449,13 @@ Mat* HuffmanTree::ToImage(HeaderOptions& header)
 
 Mat* HuffmanTree::ToImage(HeaderOptions& header, uint8_t maxLayer)
 {
+	return ToImage(header, maxLayer, WorkerPool::DefaultThreadCount());
+}
+
+Mat* HuffmanTree::ToImage(HeaderOptions& header, uint8_t maxLayer, unsigned threadCount)
+{
+	PICTS_STAGE("decode.to_image");
+
 	if (!maxLayer)
 		maxLayer = _layerCount;
 	else
@@ -372,62 +473,43 @@ Mat* HuffmanTree::ToImage(HeaderOptions& header, uint8_t maxLayer)
 	split(*image, channels);
 	uint8_t channelCount = image->channels();
 
-	uint8_t index = 0;
-	vector<list<uint8_t>> localLayerData;
-	for (auto layerData : _layerData)
+	// values were laid out by the encoder's layer count (checked by HeaderOptions::Deserialize);
+	//	earlier layers keep their positions
+	assert(header.getLayerCount() <= MAX_LAYERS && maxLayer <= header.getLayerCount());
+	const ZigzagLayout& layout = ZigzagLayouts[header.getLayerCount()];
+	uint32_t columns = width / 8, rows = height / 8,
+			 chunkCount = channelCount * columns;
+
+	// find where each block column of each channel starts in every layer
+	vector<size_t> chunkStarts[MAX_LAYERS];
+
+	WorkerPool::Run(maxLayer, threadCount, [&](uint32_t l)
 	{
-		list<uint8_t> layer(layerData->begin(), layerData->end());
-		localLayerData.push_back(layer);
-	}
+		chunkStarts[l] = _layerData[l]->chunkStarts(layout.layerSize(l), chunkCount, rows, _runLength);
+	});
 
-	int max = 10;
-	list<uint8_t> *currentLayerData;
-	for (uint8_t i = 0; i < channelCount; i++)
+	// then rebuild the block columns independently
+	WorkerPool::Run(chunkCount, threadCount, [&](uint32_t chunk)
 	{
-		Mat currentChannel = channels[i];
-		for (uint32_t j = 0; j < width; j += 8)
-			for (uint32_t k = 0; k < height; k+= 8)
-			{
-				// Mat currentBlock = currentChannel(Rect(j, k, 8, 8));
-				// Mat currentBlock(8, 8, CV_8UC1, Scalar(header.getQuality() != 100 ? 128 : 64));
-				// Mat currentBlock(8, 8, CV_8UC1, Scalar(!i ? 128 : 0));
-				// Mat currentBlock(8, 8, CV_8UC1, Scalar(!i ? 0 : 128));
-				Mat currentBlock(8, 8, CV_8SC1, Scalar(0));
-				// Mat currentBlock(8, 8, CV_8SC1, Scalar(128));
-				uint8_t currentLayer = 0, currentValueCount = 0;
-				
-				// zig-zag traverse matrix
-				ZigzagMatProcessor(&currentBlock, maxLayer, [&](int8_t* value, uint8_t index, uint8_t layer, uint8_t layerIndex)
-				{
-					// if first time through, read layer data
-					if (currentLayer < layer)
-					{
-						currentLayerData = &localLayerData[currentLayer];
-
-						// read count
-						currentValueCount = currentLayerData->front();
-						currentLayer = layer;
-
-						// if this is layer0 & there's no value, that means it's a 0
-						//	add one to value count and reuse that 0 as the value
-						if (currentLayer == 1 && currentValueCount == 0)
-							currentValueCount = 1;
-						else
-							currentLayerData->pop_front();
-					}
-
-					if (currentValueCount > layerIndex)
-					{
-						*value = currentLayerData->front();
-						currentLayerData->pop_front();
-					}
-
-					return true;
-				});
-
-				currentBlock.copyTo(currentChannel(Rect(j, k, 8, 8)));
-			}
-	}
+		Mat& currentChannel = channels[chunk / columns];
+		uint32_t j = (chunk % columns) * 8;
+
+		LayerReader readers[MAX_LAYERS];
+		for (uint8_t l = 0; l < maxLayer; l++)
+			readers[l] = LayerReader(*_layerData[l], chunkStarts[l][chunk]);
+
+		int8_t zigzag[64];
+
+		for (uint32_t k = 0; k < height; k += 8)
+		{
+			memset(zigzag, 0, sizeof(zigzag));
+
+			for (uint8_t l = 0; l < maxLayer; l++)
+				readers[l].readBlock(&zigzag[layout.layerStart[l]], layout.layerSize(l), _runLength);
+
+			ZigzagScatter(zigzag, layout, currentChannel.ptr<int8_t>(k) + j, currentChannel.step);
+		}
+	});
 
 	merge(channels, *image);
 
@@ -439,9 +521,25 @@ uint64_t HuffmanTree::SerializeLayer(ofbitstream& outputStream, uint8_t layer)
 	/// cout << "\033[1;31mHuffmanTree::SerializeLayer: " << (int)layer << "\033[0m" << endl;
 	
 	// store: length (uint64_t), number of values (uchar), tree data (uchar[])
-	map<uchar, tuple<uchar, uchar>> valueMap = Traverse(_roots[layer]);
+	HuffmanCode& code = _codes[layer];
+
+	LayerBuffer *layerData = _layerData[layer];
+
+	if (_rans)
+	{
+		// the layer's words, after the byte count & symbol count
+		uint32_t symbolCount = 0;
+		vector<uint16_t> words = _ransCodes[layer].Encode(*layerData, _runLength, symbolCount);
+		uint32_t layerBytes = sizeof(symbolCount) + words.size() * sizeof(uint16_t);
+
+		outputStream.write(reinterpret_cast<char*>(&layerBytes), sizeof(layerBytes));
+		outputStream.write(reinterpret_cast<char*>(&symbolCount), sizeof(symbolCount));
+		outputStream.write(reinterpret_cast<char*>(words.data()), words.size() * sizeof(uint16_t));
+
+		PICTS_COUNT_LAYER(layer, "symbols", symbolCount);
+		return layerBytes + sizeof(layerBytes);
+	}
 
-	list<uint8_t> *layerData = _layerData[layer];
 	uint32_t layerBits = 0,
 			 layerDataCount = layerData->size(),
 			 layerBytesLocation = outputStream.tellp();
@@ -453,13 +551,31 @@ uint64_t HuffmanTree::SerializeLayer(ofbitstream& outputStream, uint8_t layer)
 	outputStream.write(reinterpret_cast<char*>(&layerDataCount), sizeof(layerDataCount));
 
 	// get addresses for values
-	for (auto value : *layerData)
+	if (!_runLength)
+		for (uint8_t value : *layerData)
+		{
+			uint8_t length = code.getLength(value);
+			outputStream.writeBits(code.getCode(value), length);
+			layerBits += length;
+		}
+	else
 	{
-		tuple<uchar, uchar> addressTuple = valueMap[value];
+		// count symbols only; each value follows its symbol as that many raw bits
+		layerDataCount = 0;
 
-		uint8_t length = get<1>(addressTuple);
-		outputStream.writeBits(get<0>(addressTuple), length);
-		layerBits += length;
+		for (const uint8_t* symbol = layerData->begin(); symbol < layerData->end(); symbol++)
+		{
+			uint8_t length = code.getLength(*symbol), bits = *symbol & 0x0f;
+			outputStream.writeBits(code.getCode(*symbol), length);
+			layerBits += length;
+			layerDataCount++;
+
+			if (bits)
+			{
+				outputStream.writeBits(RunLengthValueBits(*++symbol, bits), bits);
+				layerBits += bits;
+			}
+		}
 	}
 
 	outputStream.flush();
@@ -471,29 +587,32 @@ uint64_t HuffmanTree::SerializeLayer(ofbitstream& outputStream, uint8_t layer)
 	// go back, write value, return
 	outputStream.seekp(layerBytesLocation);
 	outputStream.write(reinterpret_cast<char*>(&layerBytes), sizeof(layerBytes));
+	outputStream.write(reinterpret_cast<char*>(&layerDataCount), sizeof(layerDataCount));
 	outputStream.seekp(0, ios::end);
 
+	// entropy-coded symbols, not the raw run-length value bytes
+	PICTS_COUNT_LAYER(layer, "symbols", layerDataCount);
 	return serializedLayerLength;
 }
 
-int8_t HuffmanTree::_nextValueFromBitstream(ifbitstream& inputStream, HuffmanTreeNode* root)
+LayerBuffer* HuffmanTree::DeserializeLayer(ifbitstream& inputStream, const HuffmanNodeArray& tree)
 {
-	HuffmanTreeNode currentNode = *root;
+	HuffmanDecoder decoder(tree);
 
-	// keep reading values until a leaf node
-	while (currentNode.get0() && currentNode.get1())
-	{
-		uint8_t bit = inputStream.readBit();
+	return DeserializeLayer(inputStream, decoder);
+}
 
-		currentNode = bit ?
-			(currentNode = currentNode.get1() ? *currentNode.get1() : currentNode) :
-			(currentNode = currentNode.get0() ? *currentNode.get0() : currentNode) ;
-	}
+LayerBuffer* HuffmanTree::DeserializeLayer(ifbitstream& inputStream, HuffmanDecoder& decoder)
+{
+	return DeserializeLayer(inputStream, decoder, false);
+}
 
-	return currentNode.getValue();
+LayerBuffer* HuffmanTree::DeserializeLayer(ifbitstream& inputStream, HuffmanDecoder& decoder, bool runLength)
+{
+	return DeserializeLayer(inputStream, decoder, runLength, SIZE_MAX);
 }
 
-list<uint8_t>* HuffmanTree::DeserializeLayer(ifbitstream& inputStream, HuffmanTreeNode* root)
+LayerBuffer* HuffmanTree::DeserializeLayer(ifbitstream& inputStream, HuffmanDecoder& decoder, bool runLength, size_t capacity)
 {
 	/// cout << "\033[1;31mHuffmanTree::DeserializeLayer\033[0m" << endl;
 	
@@ -502,14 +621,26 @@ list<uint8_t>* HuffmanTree::DeserializeLayer(ifbitstream& inputStream, HuffmanTr
 	inputStream.read(reinterpret_cast<char*>(&layerLength), sizeof(layerLength));
 	inputStream.read(reinterpret_cast<char*>(&layerDataCount), sizeof(layerDataCount));
 
+	if (layerDataCount > capacity)
+		throw "Layer larger than the image.";
+
 	// read layer data
 	//	layer0 has no counts
-	list<uint8_t> *layerData = new list<uint8_t>();
+	LayerBuffer *layerData = new LayerBuffer(runLength ? 2 * (size_t)layerDataCount : layerDataCount);
 
 	while (layerDataCount--)
 	{
-		uint8_t value = _nextValueFromBitstream(inputStream, root);
-		layerData->push_back(value);
+		uint8_t symbol = decoder.Decode(inputStream);
+		layerData->push(symbol);
+
+		if (runLength && (symbol & 0x0f))
+		{
+			uint8_t bits = symbol & 0x0f;
+			uint32_t valueBits = inputStream.peek(bits);
+			inputStream.consume(bits);
+
+			layerData->push(RunLengthValue(valueBits, bits));
+		}
 	}
 
 	// skip rest of current byte
@@ -518,97 +649,37 @@ list<uint8_t>* HuffmanTree::DeserializeLayer(ifbitstream& inputStream, HuffmanTr
 	return layerData;
 }
 
-void HuffmanTree::ZigzagMatProcessor (Mat* mat, uint8_t layerCount, function<bool(int8_t* value, uint8_t index, uint8_t layer, uint8_t layerIndex)> elementCallback)
+LayerBuffer* HuffmanTree::DeserializeLayer(ifbitstream& inputStream, RansCode& code, bool runLength)
 {
-	return ZigzagMatProcessor(mat, layerCount, -1, elementCallback);
+	return DeserializeLayer(inputStream, code, runLength, SIZE_MAX);
 }
 
-void HuffmanTree::ZigzagMatProcessor (Mat* mat, uint8_t layerCount, int8_t stopAfterElement, function<bool(int8_t* value, uint8_t index, uint8_t layer, uint8_t layerIndex)> elementCallback)
+LayerBuffer* HuffmanTree::DeserializeLayer(ifbitstream& inputStream, RansCode& code, bool runLength, size_t capacity)
 {
-	assert(layerCount <= MAX_LAYERS);
-	
-	bool down = true, lastFix = false;
-	uint8_t rows = mat->rows - 1, cols = mat->cols - 1,
-		elements = mat->rows * mat->cols,
-		x = 0, y = 0, currentLayer = 1, layerIndex = 0;
+	uint32_t layerLength = 0, symbolCount = 0;
+	inputStream.read(reinterpret_cast<char*>(&layerLength), sizeof(layerLength));
+	inputStream.read(reinterpret_cast<char*>(&symbolCount), sizeof(symbolCount));
 
-	for (uint8_t i = 0u; i < elements; i++)
-	{
-		if (i)
-		{
-			if (!y && down)
-			{
-				x++;
-				down = false;
-
-				if (currentLayer < layerCount)
-				{
-					currentLayer++;
-					layerIndex = 0;
-				}
-
-				if (x > cols)
-				{
-					y += x - cols;
-					x = cols;
-				}
-			}
-			else if (!x && !down)
-			{
-				y++;
-				down = true;
-
-				if (currentLayer < layerCount)
-				{
-					currentLayer++;
-					layerIndex = 0;
-				}
-
-				if (y > rows)
-				{
-					x += y - rows;
-					y = rows;
-				}
-			}
-			else
-			{
-				if (down)
-				{
-					if (x == cols && !lastFix)
-					{
-						y++;
-						down = false;
-						lastFix = true;
-					}
-					else
-					{
-						x++;
-						y--;
-						lastFix = false;
-					}
-				}
-				else
-				{
-					if (y == rows && !lastFix)
-					{
-						x++;
-						down = true;
-						lastFix = true;
-					}
-					else
-					{
-						x--;
-						y++;
-						lastFix = false;
-					}
-				}
-			}
-		}
+	if (symbolCount > capacity)
+		throw "Layer larger than the image.";
 
-		int8_t* row = mat->ptr<int8_t>(y);
-		
-		// stop here if callback returned false or we're supposed to stop after this element
-		if (!elementCallback(&row[x], i, currentLayer, layerIndex++) || (stopAfterElement >= 0 && i == stopAfterElement))
-			return;
+	size_t wordCount = layerLength > sizeof(symbolCount) ? (layerLength - sizeof(symbolCount)) / sizeof(uint16_t) : 0,
+		   available = 0;
+
+	// memory streams decode the words in place
+	const uint8_t* words = inputStream.unreadBytes(available);
+
+	if (!inputStream || wordCount * sizeof(uint16_t) > available)
+		throw "Layer longer than the file.";
+
+	if (words)
+	{
+		inputStream.seekg(wordCount * sizeof(uint16_t), ios::cur);
+		return code.Decode(words, wordCount, symbolCount, runLength);
 	}
+
+	vector<uint8_t> bytes(wordCount * sizeof(uint16_t));
+	inputStream.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+
+	return code.Decode(bytes.data(), wordCount, symbolCount, runLength);
 }
@@ -2,60 +2,109 @@
 #define HuffmanTree_h
 
 #include <opencv2/opencv.hpp>
-#include <list>
 
 #include "HeaderOptions.h"
-#include "HuffmanTreeNode.h"
+#include "HuffmanNodeArray.h"
+#include "HuffmanCode.h"
+#include "HuffmanDecoder.h"
+#include "RansCode.h"
 #include "ofbitstream.h"
 #include "ifbitstream.h"
+#include "LayerBuffer.h"
+#include "Zigzag.h"
 
 using namespace std;
 using namespace cv;
 
-#define MAX_LAYERS 8
-
 class HuffmanTree
 {
 	public:
-		static void ZigzagMatProcessor (Mat*, uint8_t, function<bool(int8_t*, uint8_t, uint8_t, uint8_t)>);
-		static void ZigzagMatProcessor (Mat*, uint8_t, int8_t, function<bool(int8_t*, uint8_t, uint8_t, uint8_t)>);
-
 		// static HuffmanTree* deserialize (const uchar*);
 		static HuffmanTree* Deserialize (ifbitstream&, HeaderOptions&);
 
-		static HuffmanTreeNode* DeserializeTree (ifbitstream&, map<int8_t, uint64_t>*);
-		static list<uint8_t>* DeserializeLayer (ifbitstream&, HuffmanTreeNode*);
+		// reads the header & decodes the layers concurrently, each from its own stream
+		static HuffmanTree* Deserialize (string, HeaderOptions&, unsigned);
+
+		// only the first maxLayer layers (0: all); v2+ files seek straight to them
+		static HuffmanTree* Deserialize (string, HeaderOptions&, uint8_t, unsigned);
+
+		// the same from a whole .picts file in memory, which must outlive the call; the string
+		//	overloads map the file & read it through these
+		static HuffmanTree* Deserialize (const uint8_t*, size_t, HeaderOptions&, unsigned);
+		static HuffmanTree* Deserialize (const uint8_t*, size_t, HeaderOptions&, uint8_t, unsigned);
+
+		static HuffmanNodeArray DeserializeTree (ifbitstream&, map<int8_t, uint64_t>*);
+		static LayerBuffer* DeserializeLayer (ifbitstream&, const HuffmanNodeArray&);
+		static LayerBuffer* DeserializeLayer (ifbitstream&, HuffmanDecoder&);
+
+		// run-length layers follow each symbol with its value's bits
+		static LayerBuffer* DeserializeLayer (ifbitstream&, HuffmanDecoder&, bool);
+		static LayerBuffer* DeserializeLayer (ifbitstream&, RansCode&, bool);
+
+		// ... throwing if the layer claims more than capacity buffer bytes' worth of symbols
+		static LayerBuffer* DeserializeLayer (ifbitstream&, HuffmanDecoder&, bool, size_t);
+		static LayerBuffer* DeserializeLayer (ifbitstream&, RansCode&, bool, size_t);
 
 		static HuffmanTree* FromImage(Mat*, uint8_t);
+		static HuffmanTree* FromImage(Mat*, uint8_t, bool);
 		
 		uint8_t AddLayer(ifbitstream&);
 		static uint8_t AddLayer(ifbitstream&, HuffmanTree*);
 		Mat* ToImage(HeaderOptions&);
 		Mat* ToImage(HeaderOptions&, uint8_t);
+		Mat* ToImage(HeaderOptions&, uint8_t, unsigned);
 
 		~HuffmanTree();
 
-		static map<uchar, tuple<uchar, uchar>> Traverse(HuffmanTreeNode*);
-		static map<uchar, tuple<uchar, uchar>> Traverse(int8_t, uchar, HuffmanTreeNode*);
-
-		// returns serialized length
+		// canonical code lengths (v3+) or rANS frequencies; returns serialized length
 		uint64_t SerializeTree (ostream&, uint8_t);
 
 		// write to files; returns layer offsets (from 0)
 		uint64_t SerializeLayer(ofbitstream&, uint8_t);
 
-		HuffmanTreeNode* getRoot(uint8_t layer) { return _roots.at(layer); }
+		// only layers read from v1 / v2 files have trees (others are empty); every layer has its code
+		HuffmanNodeArray& getTree(uint8_t layer) { return _trees.at(layer); }
+		HuffmanCode& getCode(uint8_t layer) { return _codes.at(layer); }
+		RansCode& getRansCode(uint8_t layer) { return _ransCodes.at(layer); }
+		LayerBuffer* getLayerData(uint8_t layer) { return _layerData.at(layer); }
     
         uint8_t getLayerCount() { return _layerCount; }
+		bool getRunLengthCoding() { return _runLength; }
+
+		// serialize rANS layers instead of Huffman (HeaderOptions::getRANSCoding)
+		bool getRANSCoding() { return _rans; }
+		void setRANSCoding(bool rans) { _rans = rans; }
 
 	private:
-		static HuffmanTreeNode* _treeFromValueWeightMap(map<int8_t, uint64_t>*);
-		static int8_t _nextValueFromBitstream(ifbitstream&, HuffmanTreeNode*);
+		friend class StripeEncoder;
+
+		// count & values, or run-length symbols & values, of one layer of one block
+		static void _encodeLayer(const int8_t*, uint8_t, LayerBuffer&, bool);
+
+		// most buffer bytes _encodeLayer writes for one block
+		static uint8_t _blockCapacity(uint8_t layerSize, bool runLength) { return runLength ? 2 * layerSize : 1 + layerSize; }
+
+		// weights of the Huffman-coded symbols; run-length values are written as raw bits
+		static map<int8_t, uint64_t>* _valueWeightMapFromLayer(const LayerBuffer&, bool);
+		static HuffmanNodeArray _treeFromValueWeightMap(map<int8_t, uint64_t>*);
+
+		// reads one layer's tree (v1 / v2 value-weights, v3+ code lengths) & data into slot layer
+		void _readLayer(ifbitstream&, uint8_t);
+
+		// coding & image size of a file being read
+		void _setHeader(HeaderOptions&);
+
+		uint8_t _layerCount, _version;
+		bool _runLength, _rans;
 
-		uint8_t _layerCount;
+		// when reading: the file's layer layout & block count, bounding each layer's symbols (NULL: unbounded)
+		const ZigzagLayout* _layout;
+		size_t _blockCount;
 
-		vector<HuffmanTreeNode*> _roots;
-		vector<list<uint8_t>*> _layerData;
+		vector<HuffmanNodeArray> _trees;
+		vector<HuffmanCode> _codes;
+		vector<RansCode> _ransCodes;
+		vector<LayerBuffer*> _layerData;
 		vector<map<int8_t, uint64_t>*> _valueWeightMaps;
 
 		HuffmanTree(uint8_t);
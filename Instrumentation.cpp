@@ -0,0 +1,156 @@
+#include "Instrumentation.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <time.h>
+#include <sys/resource.h>
+
+struct StageTotals
+{
+	uint64_t calls, wallNanoseconds, cpuNanoseconds;
+};
+
+static atomic<bool> _enabled(false);
+static mutex _mutex;
+
+static map<string, StageTotals> _stages;
+static map<string, uint64_t> _counters;
+static vector<map<string, uint64_t> > _layers;
+
+void Instrumentation::SetEnabled(bool enabled)
+{
+	_enabled = enabled;
+}
+
+bool Instrumentation::IsEnabled()
+{
+	return _enabled;
+}
+
+void Instrumentation::AddStage(const char* name, uint64_t wallNanoseconds, uint64_t cpuNanoseconds)
+{
+	if (!_enabled)
+		return;
+
+	lock_guard<mutex> lock(_mutex);
+	StageTotals& totals = _stages[name];
+
+	totals.calls++;
+	totals.wallNanoseconds += wallNanoseconds;
+	totals.cpuNanoseconds += cpuNanoseconds;
+}
+
+void Instrumentation::Count(const char* name, uint64_t value)
+{
+	if (!_enabled)
+		return;
+
+	lock_guard<mutex> lock(_mutex);
+	_counters[name] += value;
+}
+
+void Instrumentation::CountLayer(uint8_t layer, const char* name, uint64_t value)
+{
+	if (!_enabled)
+		return;
+
+	lock_guard<mutex> lock(_mutex);
+
+	if (_layers.size() <= layer)
+		_layers.resize(layer + 1);
+
+	_layers[layer][name] += value;
+}
+
+uint64_t Instrumentation::WallNanoseconds()
+{
+	return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+uint64_t Instrumentation::ThreadCPUNanoseconds()
+{
+	timespec time;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+
+	return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+void Instrumentation::WriteJSON(ostream& os)
+{
+	lock_guard<mutex> lock(_mutex);
+
+	// kilobytes on Linux
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+
+	os << "{" << endl
+	   << "\t\"instrumented\": " <<
+#ifdef PICTS_INSTRUMENTATION
+		"true"
+#else
+		"false"
+#endif
+	   << "," << endl
+	   << "\t\"process_cpu_ms\": " << (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3 + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3 << "," << endl
+	   << "\t\"peak_rss_kb\": " << usage.ru_maxrss << "," << endl;
+
+	os << "\t\"stages\": {";
+
+	for (auto stage = _stages.begin(); stage != _stages.end(); stage++)
+		os << (stage == _stages.begin() ? "" : ",") << endl
+		   << "\t\t\"" << stage->first << "\": { \"calls\": " << stage->second.calls
+		   << ", \"wall_ms\": " << stage->second.wallNanoseconds / 1e6
+		   << ", \"cpu_ms\": " << stage->second.cpuNanoseconds / 1e6 << " }";
+
+	os << endl << "\t}," << endl
+	   << "\t\"counters\": {";
+
+	for (auto counter = _counters.begin(); counter != _counters.end(); counter++)
+		os << (counter == _counters.begin() ? "" : ",") << endl
+		   << "\t\t\"" << counter->first << "\": " << counter->second;
+
+	os << endl << "\t}," << endl
+	   << "\t\"layers\": [";
+
+	for (size_t l = 0; l < _layers.size(); l++)
+	{
+		map<string, uint64_t>& layer = _layers[l];
+		os << (l ? "," : "") << endl << "\t\t{ \"layer\": " << l;
+
+		for (auto& counter : layer)
+			os << ", \"" << counter.first << "\": " << counter.second;
+
+		auto bytes = layer.find("data_bytes"), symbols = layer.find("symbols");
+
+		if (bytes != layer.end() && symbols != layer.end() && symbols->second)
+			os << ", \"bits_per_symbol\": " << bytes->second * 8.0 / symbols->second;
+
+		os << " }";
+	}
+
+	os << endl << "\t]" << endl
+	   << "}" << endl;
+}
+
+StageTimer::StageTimer(const char* name)
+	: _name(name), _wallStart(0), _cpuStart(0)
+{
+	// a disabled stage costs a flag test
+	if (!Instrumentation::IsEnabled())
+		_name = NULL;
+	else
+	{
+		_wallStart = Instrumentation::WallNanoseconds();
+		_cpuStart = Instrumentation::ThreadCPUNanoseconds();
+	}
+}
+
+StageTimer::~StageTimer()
+{
+	if (_name)
+		Instrumentation::AddStage(_name, Instrumentation::WallNanoseconds() - _wallStart, Instrumentation::ThreadCPUNanoseconds() - _cpuStart);
+}
@@ -0,0 +1,64 @@
+#ifndef Instrumentation_h
+#define Instrumentation_h
+
+#include <iostream>
+#include <stdint.h>
+
+using namespace std;
+
+/*
+	per-stage wall & CPU time, counters & per-layer counters, written as JSON (--stats)
+
+	the PICTS_* probes compile to nothing unless PICTS_INSTRUMENTATION is defined (the CMake
+	option of that name), and only record once enabled; stages of the same name add up, so a
+	stage run per stripe or from several batch threads reports its total & its call count
+*/
+#ifdef PICTS_INSTRUMENTATION
+	#define PICTS_CONCAT_(a, b) a##b
+	#define PICTS_CONCAT(a, b) PICTS_CONCAT_(a, b)
+
+	// times the rest of the enclosing scope
+	#define PICTS_STAGE(name) StageTimer PICTS_CONCAT(_stageTimer, __LINE__)(name)
+	#define PICTS_COUNT(name, value) Instrumentation::Count(name, value)
+	#define PICTS_COUNT_LAYER(layer, name, value) Instrumentation::CountLayer(layer, name, value)
+#else
+	#define PICTS_STAGE(name) ((void)0)
+	#define PICTS_COUNT(name, value) ((void)0)
+	#define PICTS_COUNT_LAYER(layer, name, value) ((void)0)
+#endif
+
+class Instrumentation
+{
+	public:
+		static void SetEnabled(bool);
+		static bool IsEnabled();
+
+		// one run of a stage, in nanoseconds
+		static void AddStage(const char*, uint64_t, uint64_t);
+
+		static void Count(const char*, uint64_t);
+		static void CountLayer(uint8_t, const char*, uint64_t);
+
+		// everything recorded so far, the process's CPU time & peak resident set size; layers
+		//	with "data_bytes" & "symbols" also get their bits per symbol (the code tables aside)
+		static void WriteJSON(ostream&);
+
+		static uint64_t WallNanoseconds();
+
+		// the calling thread's CPU time, so stages running at once on several threads each count
+		//	only their own; work a stage hands to worker threads shows in the process total only
+		static uint64_t ThreadCPUNanoseconds();
+};
+
+class StageTimer
+{
+	public:
+		StageTimer(const char*);
+		~StageTimer();
+
+	private:
+		const char* _name;
+		uint64_t _wallStart, _cpuStart;
+};
+
+#endif
@@ -0,0 +1,5 @@
+#include "LayerBuffer.h"
+
+LayerBuffer::LayerBuffer(size_t capacity) : _data(capacity), _size(0)
+{
+}
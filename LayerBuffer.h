@@ -0,0 +1,167 @@
+#ifndef LayerBuffer_h
+#define LayerBuffer_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+/*
+	run-length blocks (HeaderOptions::getRunLengthCoding): each symbol's high nibble is a run of
+	zeros & its low nibble the bit count of the value after them, which follows in the buffer
+
+	LAYER_RUN_EOB ends the block early; LAYER_RUN_ZRL (15 zeros, no value) stands for 16 zeros
+*/
+#define LAYER_RUN_EOB 0x00
+#define LAYER_RUN_ZRL 0xf0
+
+// a run-length value as its symbol's bit count of bits; negative values as value - 1 (as JPEG)
+inline uint32_t RunLengthValueBits(int8_t value, uint8_t bits)
+{
+	return value < 0 ? value + (1 << bits) - 1 : value;
+}
+
+inline int8_t RunLengthValue(uint32_t valueBits, uint8_t bits)
+{
+	// a clear top bit means negative
+	return valueBits < (1u << (bits - 1)) ? (int32_t)valueBits - (1 << bits) + 1 : valueBits;
+}
+
+// one layer's symbols in a single pre-sized allocation
+class LayerBuffer
+{
+	public:
+		// capacity is the most symbols the layer will hold
+		LayerBuffer(size_t);
+
+		void push(uint8_t value)
+		{
+			assert(_size < _data.size());
+			_data[_size++] = value;
+		}
+
+		void append(const uint8_t* values, size_t count)
+		{
+			assert(_size + count <= _data.size());
+			memcpy(_data.data() + _size, values, count);
+			_size += count;
+		}
+
+		// grow to hold at least capacity symbols
+		void reserve(size_t capacity)
+		{
+			if (capacity > _data.size())
+				_data.resize(capacity);
+		}
+
+		const uint8_t* begin() const { return _data.data(); }
+		const uint8_t* end() const { return _data.data() + _size; }
+
+		// where each run of blocksPerChunk blocks starts, for chunkCount runs; each block is a
+		//	count (values past layerSize are ignored) & that many values, as HuffmanTree writes them,
+		//	or run-length symbols up to an EOB or layerSize values
+		vector<size_t> chunkStarts(uint8_t layerSize, uint32_t chunkCount, uint32_t blocksPerChunk) const
+		{
+			return chunkStarts(layerSize, chunkCount, blocksPerChunk, false);
+		}
+
+		vector<size_t> chunkStarts(uint8_t layerSize, uint32_t chunkCount, uint32_t blocksPerChunk, bool runLength) const
+		{
+			vector<size_t> starts;
+			starts.reserve(chunkCount);
+
+			size_t position = 0;
+			for (uint32_t chunk = 0; chunk < chunkCount; chunk++)
+			{
+				starts.push_back(position);
+
+				for (uint32_t block = 0; block < blocksPerChunk; block++)
+				{
+					if (!runLength)
+					{
+						position += 1 + (position < _size ? min(_data[position], layerSize) : 0);
+						continue;
+					}
+
+					// consumes exactly what LayerReader::readBlock does
+					for (uint8_t filled = 0; filled < layerSize && position < _size; )
+					{
+						uint8_t symbol = _data[position++];
+
+						if (symbol == LAYER_RUN_EOB)
+							break;
+
+						filled += min((symbol >> 4) + 1, layerSize - filled);
+
+						if (symbol & 0x0f)
+							position++;
+					}
+				}
+			}
+
+			return starts;
+		}
+
+		size_t size() const { return _size; }
+		size_t capacity() const { return _data.size(); }
+
+	private:
+		vector<uint8_t> _data;
+		size_t _size;
+};
+
+// reads a LayerBuffer front to back without consuming it; reads past the end yield 0
+class LayerReader
+{
+	public:
+		LayerReader() : _position(NULL), _end(NULL) { }
+		LayerReader(const LayerBuffer& buffer) : _position(buffer.begin()), _end(buffer.end()) { }
+		LayerReader(const LayerBuffer& buffer, size_t offset) : _position(buffer.begin() + min(offset, buffer.size())), _end(buffer.end()) { }
+
+		uint8_t next() { return _position < _end ? *_position++ : 0; }
+
+		// one block's layer into values; returns how many were written (the rest are 0)
+		uint8_t readBlock(int8_t* values, uint8_t layerSize, bool runLength)
+		{
+			// a count & that many values; a 0 count in layer 0 doubles as its 0 value
+			if (!runLength)
+			{
+				uint8_t count = min(next(), layerSize);
+
+				for (uint8_t e = 0; e < count; e++)
+					values[e] = next();
+
+				return count;
+			}
+
+			uint8_t filled = 0;
+
+			// reads past the end yield EOB
+			while (filled < layerSize)
+			{
+				uint8_t symbol = next();
+
+				if (symbol == LAYER_RUN_EOB)
+					break;
+
+				for (uint8_t run = symbol >> 4; run && filled < layerSize; run--)
+					values[filled++] = 0;
+
+				int8_t value = symbol & 0x0f ? next() : 0;
+
+				if (filled < layerSize)
+					values[filled++] = value;
+			}
+
+			return filled;
+		}
+
+	private:
+		const uint8_t *_position, *_end;
+};
+
+#endif
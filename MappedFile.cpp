@@ -0,0 +1,47 @@
+#include "MappedFile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile(string fileName)
+	: _data(NULL), _size(0)
+{
+	int file = open(fileName.c_str(), O_RDONLY);
+
+	if (file < 0)
+		throw "Error opening file.";
+
+	struct stat status;
+
+	if (fstat(file, &status) < 0)
+	{
+		close(file);
+		throw "Error opening file.";
+	}
+
+	_size = status.st_size;
+
+	if (_size)
+	{
+		void* data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, file, 0);
+
+		if (data == MAP_FAILED)
+		{
+			close(file);
+			throw "Error mapping file.";
+		}
+
+		_data = (const uint8_t*)data;
+	}
+
+	// the mapping stays valid without the descriptor
+	close(file);
+}
+
+MappedFile::~MappedFile()
+{
+	if (_data)
+		munmap((void*)_data, _size);
+}
@@ -0,0 +1,29 @@
+#ifndef MappedFile_h
+#define MappedFile_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+using namespace std;
+
+// a whole file mapped read-only into memory (for ifbitstream's memory reader); unmapped when destroyed
+class MappedFile
+{
+	public:
+		MappedFile(string);
+		~MappedFile();
+
+		const uint8_t* data() { return _data; }
+		size_t size() { return _size; }
+
+	private:
+		// an empty file maps nothing: NULL & 0
+		const uint8_t* _data;
+		size_t _size;
+
+		MappedFile(const MappedFile&);
+		MappedFile& operator= (const MappedFile&);
+};
+
+#endif
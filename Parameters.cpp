@@ -1,10 +1,13 @@
 #include <sys/stat.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sstream>
 
 #include "Parameters.h"
+#include "HuffmanDecoder.h"
 
 Parameters::Parameters()
-	: YUVConversion(true), HuffmanCoding(true), Subtract128(true) { }
+	: YUVConversion(true), HuffmanCoding(true), Subtract128(true), RunLengthCoding(false), Batch(false), Decode(false), Metrics(false), Quality(0), MaxCodeLength(0), ThreadCount(0) { }
 
 Parameters Parameters::ParseCommandLine(int argc, char** argv)
 {
@@ -19,7 +22,13 @@ Parameters Parameters::ParseCommandLine(int argc, char** argv)
 	{
 		char* current = argv[i];
 
-		if (current[0] == '-')
+		// long options
+		if (!strcmp(current, "--metrics"))
+			parameters.Metrics = true;
+		else if (!strncmp(current, "--stats=", 8) && current[8] != '\0')
+			parameters.StatsFileName = string(current + 8);
+		// a lone - is a path (stdin)
+		else if (current[0] == '-' && current[1] != '\0')
 			for (int j = 1; current[j] != '\0'; j++)
 				switch (current[j])
 				{
@@ -29,20 +38,68 @@ Parameters Parameters::ParseCommandLine(int argc, char** argv)
 					case 'u':
 						parameters.HuffmanCoding = _extractParameter(current[++j], "Unrecognized Huffman option value");
 						break;
+					case 'b':
+						parameters.Batch = true;
+						break;
+					case 'd':
+						parameters.Decode = true;
+						break;
+					case 'r':
+						parameters.RunLengthCoding = _extractParameter(current[++j], "Unrecognized run-length option value");
+						break;
 					// case 's':
 					// 	parameters.Subtract128 = _extractParameter(current[++j], "Unrecognized -128 option value");
 					// 	break;
 					case 'q':
 						{
+							// -q<N> or a list, -q<N>,<N>,...
 							string quality(current);
-							parameters.Quality = stoi(quality.substr(2));
+							stringstream list(quality.substr(2));
+							parameters.Qualities.clear();
+
+							for (string item; getline(list, item, ','); )
+							{
+								int value = atoi(item.c_str());
+
+								if (value <= 0 || value > 100 || item.find_first_not_of("0123456789") != string::npos)
+									_printUsageExit("Unrecognized quality value", 1);
+
+								parameters.Qualities.push_back(value);
+							}
 
-							if (parameters.Quality == 0)
+							if (parameters.Qualities.empty())
 								_printUsageExit("Unrecognized quality value", 1);
+
+							parameters.Quality = parameters.Qualities[0];
 							
 							j = quality.size() - 1;
 							break;
 						}
+					case 'l':
+						{
+							// 8 bits fit every byte value
+							string length(current);
+							int maxCodeLength = atoi(length.substr(2).c_str());
+
+							if (maxCodeLength < 8 || maxCodeLength > HUFFMAN_MAX_CODE_LENGTH)
+								_printUsageExit("Unrecognized code length limit", 1);
+
+							parameters.MaxCodeLength = maxCodeLength;
+
+							j = length.size() - 1;
+							break;
+						}
+					case 'j':
+						{
+							// -j<N> or -j <N>
+							string threads(current[j + 1] != '\0' ? current + j + 1 : (i + 1 < argc ? argv[++i] : ""));
+
+							if (threads.find_first_not_of("0123456789") != string::npos || !(parameters.ThreadCount = atoi(threads.c_str())))
+								_printUsageExit("Unrecognized thread count", 1);
+
+							j = strlen(current) - 1;
+							break;
+						}
 					default:
 						_printUsageExit("Unrecognized options: " + string(current), 1);
 				}
@@ -50,9 +107,9 @@ Parameters Parameters::ParseCommandLine(int argc, char** argv)
 		{
 			if (parameters.InputFileName == "")
 			{
-				// stat input file
+				// stat input file; a batch manifest may come from stdin
 				struct stat buffer;
-				if (!stat(current, &buffer))
+				if (!stat(current, &buffer) || (parameters.Batch && string(current) == "-"))
 					parameters.InputFileName = string(current);
 				else
 					_printUsageExit("Invalid input file path: " + string(current), 1);
@@ -66,15 +123,20 @@ Parameters Parameters::ParseCommandLine(int argc, char** argv)
 
 	if (parameters.InputFileName == "")
 		_printUsageExit("No input file specified.", 1);
+
+	if (parameters.Decode && parameters.Batch)
+		_printUsageExit("Decoding is one file at a time.", 1);
 	
-	if (parameters.OutputFileName == "")
+	// batch outputs go to the output directory, or next to their inputs
+	if (parameters.OutputFileName == "" && !parameters.Batch)
 	{
 		size_t lastDot = parameters.InputFileName.find_last_of(".");
+		string extension = parameters.Decode ? ".png" : ".picts";
 
 		if (lastDot == string::npos)
-			parameters.OutputFileName = parameters.InputFileName + ".picts";
+			parameters.OutputFileName = parameters.InputFileName + extension;
 		else
-			parameters.OutputFileName = parameters.InputFileName.substr(0, lastDot) + ".picts";
+			parameters.OutputFileName = parameters.InputFileName.substr(0, lastDot) + extension;
 	}
 
 	return parameters;
@@ -87,10 +149,25 @@ void Parameters::_printUsageExit(string errorMessage, int code)
 
 	(code != 0 ? cerr : cout)
 		<< "usage: picts-compressor [options] <input file path> [output path]" << endl
+		<< "       picts-compressor -b [options] <directory | manifest | -> [output directory]" << endl
+		<< "       picts-compressor -d [-j<N>] [--stats=<file>] <.picts file> [output image path]" << endl
 		<< "Options:" << endl
 		<< "    -h         this help text" << endl
 		<< "    -c<1/0>    do YUV color conversion; default 1" << endl
-		<< "If no output path is specified, input file path with .picts extension is used." << endl;
+		<< "    -u<1/0>    Huffman (1) or rANS (0) entropy coding; default 1" << endl
+		<< "    -r<1/0>    code layers as (zero run, value bits) symbols; default 0" << endl
+		<< "    -b         batch: every file of a directory, or listed one per line in a manifest" << endl
+		<< "               (- reads it from stdin); one results row per file, in order" << endl
+		<< "    -q<N>[,N]  quality 1-100; a list encodes each from one DCT, to <output>_<N>.picts" << endl
+		<< "    -j<N>      encode on N threads (batch: files at once); default 1 (batch: all cores)" << endl
+		<< "    -l<N>      limit Huffman codes to N bits (8-24); default 12" << endl
+		<< "    --metrics  decode every layer as it's written & add the PSNR & SSIM of the full-size" << endl
+		<< "               image so far to the results" << endl
+		<< "    --stats=<file>" << endl
+		<< "               write per-stage times & per-layer counters as JSON (- for stdout)" << endl
+		<< "    -d         decode a .picts file to an image (its type by extension); prints a row of" << endl
+		<< "               the output path, width, height & layer count" << endl
+		<< "If no output path is specified, input file path with .picts (decoding: .png) extension is used." << endl;
 
 	exit(code);
 }
@@ -113,10 +190,24 @@ bool Parameters::_extractParameter(char value, string errorMessage)
 ostream& operator<< (ostream& os, Parameters& parameters)
 {
 	// rebuild args for serialization
-	os << "-c"  << parameters.YUVConversion
+	os << (parameters.Batch ? "-b " : "")
+	   << (parameters.Decode ? "-d " : "")
+	   << (parameters.Metrics ? "--metrics " : "")
+	   << (parameters.StatsFileName != "" ? "--stats=" + parameters.StatsFileName + " " : "")
+	   << "-c"  << parameters.YUVConversion
 	   << " -u" << parameters.HuffmanCoding
+	   << " -r" << parameters.RunLengthCoding
 	//    << " -s" << parameters.Subtract128
-	   << " -q" << (int)parameters.Quality
+	   << " -q";
+
+	if (parameters.Qualities.empty())
+		os << (int)parameters.Quality;
+
+	for (size_t i = 0; i < parameters.Qualities.size(); i++)
+		os << (i ? "," : "") << (int)parameters.Qualities[i];
+
+	os << " -l" << (int)parameters.MaxCodeLength
+	   << " -j" << parameters.ThreadCount
 	   << " "   << parameters.InputFileName
 	   << " "   << parameters.OutputFileName;
 	return os;
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <vector>
 
 using namespace std;
 
@@ -6,8 +7,18 @@ class Parameters
 {
 	public:
 		string InputFileName, OutputFileName;
-		bool YUVConversion, HuffmanCoding, Subtract128;
-		uint8_t Quality;
+		// --stats=<file>: per-stage timings & counters as JSON (- for stdout); empty if not asked for
+		string StatsFileName;
+		bool YUVConversion, HuffmanCoding, Subtract128, RunLengthCoding, Batch;
+		// -d: decode a .picts file to an image instead of encoding
+		bool Decode;
+		// --metrics: decode each layer as it's written & report its PSNR
+		bool Metrics;
+		uint8_t Quality, MaxCodeLength;
+		// -q<a>,<b>,...: every quality to encode (Quality is the first); empty if no -q
+		vector<uint8_t> Qualities;
+		// 0: 1 for a single file, every hardware thread for a batch
+		unsigned ThreadCount;
 
 		Parameters();
 
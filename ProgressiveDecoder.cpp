@@ -0,0 +1,121 @@
+#include "ProgressiveDecoder.h"
+#include "Utilities.h"
+#include "WorkerPool.h"
+#include "Zigzag.h"
+
+static QuantizationTable _quantizationTable(uint8_t quality, bool chrominance)
+{
+	Mat* quantizationMatricies = Utilities::GenerateQuantizationMatricies((double)quality);
+	QuantizationTable table(quantizationMatricies[chrominance].ptr<double>());
+	delete [] quantizationMatricies;
+
+	return table;
+}
+
+ProgressiveDecoder::ProgressiveDecoder(HeaderOptions& header, unsigned threadCount)
+	: ProgressiveDecoder(header, threadCount, BLOCK_SIZE) { }
+
+ProgressiveDecoder::ProgressiveDecoder(HeaderOptions& header, unsigned threadCount, uint8_t scale)
+	: _header(header), _threadCount(threadCount), _layerCount(0),
+	  _columns(header.getPadWidth() / 8), _rows(header.getPadHeight() / 8),
+	  _luminance(_quantizationTable(header.getQuality(), false)),
+	  _chrominance(_quantizationTable(header.getQuality(), true)),
+	  _scale(scale)
+{
+	// as HeaderOptions::Deserialize checks
+	assert(header.getLayerCount() <= MAX_LAYERS);
+
+	if (!scale || scale > BLOCK_SIZE)
+		throw "Invalid decoding scale.";
+
+	// no coefficients: every sample is the +128 level shift
+	for (uint8_t i = 0; i < header.getChannelCount(); i++)
+	{
+		_coefficients.push_back(Mat(_rows * 8, _columns * 8, CV_8SC1, Scalar(0)));
+		_samples.push_back(Mat(_rows * scale, _columns * scale, CV_8UC1, Scalar(128)));
+	}
+
+	_dirty.resize(_coefficients.size() * _columns * _rows, 0);
+}
+
+uint8_t ProgressiveDecoder::AddLayer(const LayerBuffer& layerData)
+{
+	if (_layerCount >= max(_header.getLayerCount(), (uint8_t)1))
+		throw "No more layers to add.";
+
+	// values were laid out by the encoder's layer count
+	const ZigzagLayout& layout = ZigzagLayouts[_header.getLayerCount()];
+	uint8_t layer = _layerCount, layerSize = layout.layerSize(layer);
+	const ZigzagEntry* entries = &layout.entries[layout.layerStart[layer]];
+
+	uint32_t chunkCount = _coefficients.size() * _columns;
+	vector<size_t> chunkStarts = layerData.chunkStarts(layerSize, chunkCount, _rows, _header.getRunLengthCoding());
+
+	WorkerPool::Run(chunkCount, _threadCount, [&](uint32_t chunk)
+	{
+		Mat& plane = _coefficients[chunk / _columns];
+		uint32_t j = (chunk % _columns) * 8;
+
+		LayerReader reader(layerData, chunkStarts[chunk]);
+		int8_t values[BLOCK_ELEMENTS];
+
+		for (uint32_t k = 0; k < _rows; k++)
+		{
+			uint8_t valueCount = reader.readBlock(values, layerSize, _header.getRunLengthCoding());
+
+			// coefficients start at 0, so only non-zero values change a block, & only those
+			//	within the scale change its samples
+			for (uint8_t e = 0; e < valueCount; e++)
+			{
+				int8_t value = values[e];
+
+				if (value)
+				{
+					plane.ptr<int8_t>(k * 8 + entries[e].row)[j + entries[e].col] = value;
+
+					if (entries[e].row < _scale && entries[e].col < _scale)
+						_dirty[chunk * _rows + k] = 1;
+				}
+			}
+		}
+	});
+
+	return ++_layerCount;
+}
+
+Mat ProgressiveDecoder::ToMat()
+{
+	WorkerPool::Run(_coefficients.size() * _columns, _threadCount, [&](uint32_t chunk)
+	{
+		uint32_t i = chunk / _columns, j = (chunk % _columns) * 8;
+		Mat &currentChannel = _coefficients[i],
+			&outputChannel = _samples[i];
+
+		int16_t coefficients[BLOCK_ELEMENTS];
+
+		for (uint32_t k = 0; k < _rows; k++)
+		{
+			if (!_dirty[chunk * _rows + k])
+				continue;
+
+			for (uint32_t y = 0; y < 8; y++)
+			{
+				const int8_t* row = currentChannel.ptr<int8_t>(k * 8 + y) + j;
+
+				for (uint32_t x = 0; x < 8; x++)
+					coefficients[y * 8 + x] = row[x];
+			}
+
+			// dequantization, iDCT, +128 & clamp in one pass
+			BlockTransform::DequantizeInverseScaled(coefficients, !i ? _luminance : _chrominance, _scale, outputChannel.ptr<uint8_t>(k * _scale) + j / 8 * _scale, outputChannel.step);
+
+			_dirty[chunk * _rows + k] = 0;
+		}
+	});
+
+	Mat samples;
+	merge(_samples, samples);
+
+	// cropped & color converted as a preview of _scale layers
+	return Utilities::SamplesToMat(samples, &_header, _scale);
+}
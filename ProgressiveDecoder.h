@@ -0,0 +1,54 @@
+#ifndef ProgressiveDecoder_h
+#define ProgressiveDecoder_h
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+
+#include "BlockTransform.h"
+#include "HeaderOptions.h"
+#include "LayerBuffer.h"
+
+using namespace std;
+using namespace cv;
+
+/*
+	decodes a file layer by layer, keeping the coefficients & samples between layers
+
+	the output scale is fixed (full size, or scale/8 as Utilities::ToMat's previews): AddLayer only
+	writes the new layer's coefficients, & ToMat only re-runs the inverse DCT of blocks whose
+	coefficients within the scale changed since the last ToMat
+*/
+class ProgressiveDecoder
+{
+	public:
+		ProgressiveDecoder(HeaderOptions&, unsigned);
+
+		// decodes at scale/8 size (1-8), from the top-left scale x scale coefficients of each block
+		ProgressiveDecoder(HeaderOptions&, unsigned, uint8_t);
+
+		// the next layer's symbols (HuffmanTree::getLayerData); returns the layers added so far
+		uint8_t AddLayer(const LayerBuffer&);
+
+		// the image from the layers so far, at the decoder's scale
+		Mat ToMat();
+
+		uint8_t getLayerCount() { return _layerCount; }
+
+	private:
+		HeaderOptions _header;
+		unsigned _threadCount;
+
+		uint8_t _layerCount;
+		uint32_t _columns, _rows;
+
+		QuantizationTable _luminance, _chrominance;
+
+		// per channel: CV_8SC1 coefficients & CV_8UC1 samples, _scale x _scale per block
+		vector<Mat> _coefficients, _samples;
+		uint8_t _scale;
+
+		// blocks with coefficients newer than their samples; per channel, per block column, top to bottom
+		vector<uint8_t> _dirty;
+};
+
+#endif
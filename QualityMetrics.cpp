@@ -0,0 +1,219 @@
+#include "QualityMetrics.h"
+#include "WorkerPool.h"
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#define SSIM_WINDOW (2 * SSIM_RADIUS + 1)
+#define SSIM_SPAN (METRICS_TILE_SIZE + 2 * SSIM_RADIUS)
+
+// (0.01 * 255)^2 & (0.03 * 255)^2, as Utilities::getMSSIM
+#define SSIM_C1 6.5025f
+#define SSIM_C2 58.5225f
+
+// the SSIM window's weights, normalized (as cv::getGaussianKernel)
+struct GaussianWindow
+{
+	float weights[SSIM_WINDOW];
+
+	GaussianWindow()
+	{
+		double values[SSIM_WINDOW], sum = 0.0;
+
+		for (int k = 0; k < SSIM_WINDOW; k++)
+			sum += values[k] = exp(-(k - SSIM_RADIUS) * (k - SSIM_RADIUS) / (2.0 * SSIM_SIGMA * SSIM_SIGMA));
+
+		for (int k = 0; k < SSIM_WINDOW; k++)
+			weights[k] = values[k] / sum;
+	}
+};
+
+// mirrors positions past either edge without repeating it (cv::BORDER_REFLECT_101, GaussianBlur's default)
+static inline int _reflect(int position, int size)
+{
+	if (size == 1)
+		return 0;
+
+	while (position < 0 || position >= size)
+		position = position < 0 ? -position : 2 * size - 2 - position;
+
+	return position;
+}
+
+ImageQuality QualityMetrics::ComparePSNR(const Mat& first, const Mat& second, unsigned threadCount)
+{
+	return _compare(first, second, false, threadCount);
+}
+
+ImageQuality QualityMetrics::Compare(const Mat& first, const Mat& second, unsigned threadCount)
+{
+	return _compare(first, second, true, threadCount);
+}
+
+ImageQuality QualityMetrics::_compare(const Mat& first, const Mat& second, bool ssim, unsigned threadCount)
+{
+	if (first.depth() != CV_8U || first.type() != second.type() || first.size() != second.size() || first.empty() || first.channels() > METRICS_MAX_CHANNELS)
+		throw "Metrics need two CV_8U images of one size.";
+
+	uint32_t tileColumns = (first.cols + METRICS_TILE_SIZE - 1) / METRICS_TILE_SIZE,
+			 tileRows = (first.rows + METRICS_TILE_SIZE - 1) / METRICS_TILE_SIZE;
+
+	vector<TileSums> tiles(tileColumns * tileRows);
+
+	WorkerPool::Run(tiles.size(), threadCount, [&](uint32_t t)
+	{
+		int x = (t % tileColumns) * METRICS_TILE_SIZE, y = (t / tileColumns) * METRICS_TILE_SIZE;
+		Rect tile(x, y, min(METRICS_TILE_SIZE, first.cols - x), min(METRICS_TILE_SIZE, first.rows - y));
+
+		TileSums& sums = tiles[t];
+		memset(&sums, 0, sizeof(sums));
+
+		_squaredError(first, second, tile, sums);
+
+		if (ssim)
+			_ssim(first, second, tile, sums);
+	});
+
+	ImageQuality quality;
+	memset(&quality, 0, sizeof(quality));
+	quality.channelCount = first.channels();
+
+	// in tile order, for any thread count
+	uint64_t squaredError = 0;
+	double pixels = (double)first.total();
+
+	for (uint8_t c = 0; c < quality.channelCount; c++)
+	{
+		uint64_t channelError = 0;
+		double channelSSIM = 0.0;
+
+		for (TileSums& sums : tiles)
+		{
+			channelError += sums.squaredError[c];
+			channelSSIM += sums.ssim[c];
+		}
+
+		quality.channelPSNR[c] = channelError ? 10.0 * log10(255.0 * 255.0 / (channelError / pixels)) : 0.0;
+		squaredError += channelError;
+
+		if (ssim)
+		{
+			quality.channelSSIM[c] = channelSSIM / pixels;
+			quality.ssim += quality.channelSSIM[c] / quality.channelCount;
+		}
+	}
+
+	quality.psnr = squaredError ? 10.0 * log10(255.0 * 255.0 / (squaredError / (pixels * quality.channelCount))) : 0.0;
+
+	return quality;
+}
+
+void QualityMetrics::_squaredError(const Mat& first, const Mat& second, Rect tile, TileSums& sums)
+{
+	int channels = first.channels();
+
+	for (int y = tile.y; y < tile.y + tile.height; y++)
+	{
+		const uint8_t *a = first.ptr<uint8_t>(y) + tile.x * channels,
+					  *b = second.ptr<uint8_t>(y) + tile.x * channels;
+
+		// a tile row's squares fit 32 bits
+		uint32_t rowError[METRICS_MAX_CHANNELS] = { 0 };
+
+		for (int x = 0; x < tile.width; x++)
+			for (int c = 0; c < channels; c++)
+			{
+				int32_t difference = (int32_t)a[x * channels + c] - b[x * channels + c];
+				rowError[c] += difference * difference;
+			}
+
+		for (int c = 0; c < channels; c++)
+			sums.squaredError[c] += rowError[c];
+	}
+}
+
+void QualityMetrics::_ssim(const Mat& first, const Mat& second, Rect tile, TileSums& sums)
+{
+	static const GaussianWindow window;
+	const float* weights = window.weights;
+
+	enum { A, B, AA, BB, AB, Planes };
+
+	int channels = first.channels(),
+		columns = tile.width + 2 * SSIM_RADIUS, rows = tile.height + 2 * SSIM_RADIUS;
+
+	// the tile & its margin's source columns, mirrored at the image's edges
+	int sourceColumns[SSIM_SPAN];
+	for (int x = 0; x < columns; x++)
+		sourceColumns[x] = _reflect(tile.x - SSIM_RADIUS + x, first.cols) * channels;
+
+	// one source row of each plane, then every row's horizontal pass
+	float source[Planes][SSIM_SPAN];
+	vector<float> horizontal(Planes * rows * METRICS_TILE_SIZE);
+
+	for (int c = 0; c < channels; c++)
+	{
+		for (int r = 0; r < rows; r++)
+		{
+			int sourceRow = _reflect(tile.y - SSIM_RADIUS + r, first.rows);
+			const uint8_t *a = first.ptr<uint8_t>(sourceRow) + c,
+						  *b = second.ptr<uint8_t>(sourceRow) + c;
+
+			for (int x = 0; x < columns; x++)
+			{
+				float valueA = a[sourceColumns[x]], valueB = b[sourceColumns[x]];
+
+				source[A][x] = valueA;
+				source[B][x] = valueB;
+				source[AA][x] = valueA * valueA;
+				source[BB][x] = valueB * valueB;
+				source[AB][x] = valueA * valueB;
+			}
+
+			// tap by tap, so the inner loops run over contiguous columns & vectorize
+			for (int p = 0; p < Planes; p++)
+			{
+				float* output = &horizontal[(p * rows + r) * METRICS_TILE_SIZE];
+
+				for (int x = 0; x < tile.width; x++)
+					output[x] = 0.0f;
+
+				for (int k = 0; k < SSIM_WINDOW; k++)
+					for (int x = 0; x < tile.width; x++)
+						output[x] += weights[k] * source[p][x + k];
+			}
+		}
+
+		// vertical pass & the SSIM map, a row at a time
+		for (int y = 0; y < tile.height; y++)
+		{
+			float means[Planes][METRICS_TILE_SIZE] = { { 0.0f } };
+
+			for (int p = 0; p < Planes; p++)
+				for (int k = 0; k < SSIM_WINDOW; k++)
+				{
+					const float* input = &horizontal[(p * rows + y + k) * METRICS_TILE_SIZE];
+
+					for (int x = 0; x < tile.width; x++)
+						means[p][x] += weights[k] * input[x];
+				}
+
+			float rowSSIM = 0.0f;
+
+			for (int x = 0; x < tile.width; x++)
+			{
+				float meanA2 = means[A][x] * means[A][x],
+					  meanB2 = means[B][x] * means[B][x],
+					  meanAB = means[A][x] * means[B][x];
+
+				float numerator = (2.0f * meanAB + SSIM_C1) * (2.0f * (means[AB][x] - meanAB) + SSIM_C2),
+					  denominator = (meanA2 + meanB2 + SSIM_C1) * ((means[AA][x] - meanA2) + (means[BB][x] - meanB2) + SSIM_C2);
+
+				rowSSIM += numerator / denominator;
+			}
+
+			sums.ssim[c] += rowSSIM;
+		}
+	}
+}
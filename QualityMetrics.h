@@ -0,0 +1,60 @@
+#ifndef QualityMetrics_h
+#define QualityMetrics_h
+
+#include <opencv2/opencv.hpp>
+#include <stdint.h>
+
+using namespace std;
+using namespace cv;
+
+// square tiles the metrics are computed in, each with its own filter buffers
+#define METRICS_TILE_SIZE 64
+#define METRICS_MAX_CHANNELS 4
+
+// SSIM window: the 11x11 Gaussian (sigma 1.5) of Utilities::getMSSIM
+#define SSIM_RADIUS 5
+#define SSIM_SIGMA 1.5
+
+// results of one comparison, per channel & over every channel
+struct ImageQuality
+{
+	uint8_t channelCount;
+
+	// PSNR of each channel & of all of them (as Utilities::getPSNR); 0 for identical images
+	double channelPSNR[METRICS_MAX_CHANNELS], psnr;
+
+	// mean SSIM of each channel & their mean; 0 unless computed
+	double channelSSIM[METRICS_MAX_CHANNELS], ssim;
+};
+
+/*
+	PSNR & SSIM of two CV_8U images of one size, tile by tile
+
+	each tile is read with its window's margin & filtered separably into tile-sized buffers,
+	so memory doesn't grow with the images; tiles are spread over threads & their sums added
+	in tile order, so results are identical for any thread count
+*/
+class QualityMetrics
+{
+	public:
+		// PSNR only
+		static ImageQuality ComparePSNR(const Mat&, const Mat&, unsigned);
+
+		// PSNR & SSIM
+		static ImageQuality Compare(const Mat&, const Mat&, unsigned);
+
+	private:
+		// one tile's squared errors & SSIM map sums, per channel
+		struct TileSums
+		{
+			uint64_t squaredError[METRICS_MAX_CHANNELS];
+			double ssim[METRICS_MAX_CHANNELS];
+		};
+
+		static ImageQuality _compare(const Mat&, const Mat&, bool, unsigned);
+
+		static void _squaredError(const Mat&, const Mat&, Rect, TileSums&);
+		static void _ssim(const Mat&, const Mat&, Rect, TileSums&);
+};
+
+#endif
@@ -0,0 +1,276 @@
+#include "RansCode.h"
+
+#include <algorithm>
+#include <memory>
+#include <string.h>
+
+#define RANS_TOTAL (1u << RANS_PROBABILITY_BITS)
+
+RansCode::RansCode()
+{
+	memset(_frequencies, 0, sizeof(_frequencies));
+	memset(_starts, 0, sizeof(_starts));
+}
+
+RansCode RansCode::FromWeights(const map<int8_t, uint64_t>& valueWeightMap)
+{
+	RansCode code;
+
+	uint64_t total = 0;
+	for (auto valueWeight : valueWeightMap)
+		total += valueWeight.second;
+
+	if (!total)
+		return code;
+
+	// scale to the probability range; every symbol keeps at least one slot
+	int32_t sum = 0;
+	uint8_t largest = (uint8_t)valueWeightMap.begin()->first;
+
+	for (auto valueWeight : valueWeightMap)
+	{
+		uint8_t value = valueWeight.first;
+		code._frequencies[value] = max((uint64_t)1, (valueWeight.second * RANS_TOTAL + total / 2) / total);
+		sum += code._frequencies[value];
+
+		if (code._frequencies[value] > code._frequencies[largest])
+			largest = value;
+	}
+
+	// rounding error goes to (or comes from) the most frequent symbols
+	if (sum <= (int32_t)RANS_TOTAL)
+		code._frequencies[largest] += RANS_TOTAL - sum;
+	else
+		while (sum > (int32_t)RANS_TOTAL)
+		{
+			for (uint16_t value = 0; value < 256; value++)
+				if (code._frequencies[value] > code._frequencies[largest])
+					largest = value;
+
+			uint16_t take = min(sum - (int32_t)RANS_TOTAL, (int32_t)code._frequencies[largest] / 2);
+			code._frequencies[largest] -= take;
+			sum -= take;
+		}
+
+	uint16_t start = 0;
+	for (uint16_t value = 0; value < 256; value++)
+	{
+		code._starts[value] = start;
+		start += code._frequencies[value];
+	}
+
+	code._buildSlots();
+
+	return code;
+}
+
+uint64_t RansCode::Serialize(ostream& outputStream)
+{
+	vector<uint8_t> symbols, frequencies;
+
+	for (uint16_t value = 0; value < 256; value++)
+		if (_frequencies[value])
+		{
+			symbols.push_back(value);
+
+			if (_frequencies[value] < 0x80)
+				frequencies.push_back(_frequencies[value]);
+			else
+			{
+				frequencies.push_back(0x80 | _frequencies[value] >> 8);
+				frequencies.push_back(_frequencies[value] & 0xff);
+			}
+		}
+
+	uint16_t symbolCount = symbols.size();
+
+	outputStream.write(reinterpret_cast<const char*>(&symbolCount), sizeof(symbolCount));
+	outputStream.write(reinterpret_cast<const char*>(symbols.data()), symbols.size());
+	outputStream.write(reinterpret_cast<const char*>(frequencies.data()), frequencies.size());
+
+	return sizeof(symbolCount) + symbols.size() + frequencies.size();
+}
+
+RansCode RansCode::Deserialize(istream& inputStream)
+{
+	RansCode code;
+
+	uint16_t symbolCount = 0;
+	inputStream.read(reinterpret_cast<char*>(&symbolCount), sizeof(symbolCount));
+
+	if (!symbolCount)
+		return code;
+
+	if (symbolCount > 256)
+		throw "Invalid rANS frequencies.";
+
+	vector<uint8_t> symbols(symbolCount);
+	inputStream.read(reinterpret_cast<char*>(symbols.data()), symbolCount);
+
+	uint32_t sum = 0;
+
+	for (uint8_t value : symbols)
+	{
+		uint8_t high = 0, low = 0;
+		inputStream.read(reinterpret_cast<char*>(&high), sizeof(high));
+
+		if (high & 0x80)
+			inputStream.read(reinterpret_cast<char*>(&low), sizeof(low));
+
+		uint16_t frequency = high & 0x80 ? (high & 0x7f) << 8 | low : high;
+
+		if (!frequency || code._frequencies[value])
+			throw "Invalid rANS frequencies.";
+
+		code._frequencies[value] = frequency;
+		sum += frequency;
+	}
+
+	if (!inputStream)
+		throw "File too short.";
+
+	if (sum != RANS_TOTAL)
+		throw "Invalid rANS frequencies.";
+
+	uint16_t start = 0;
+	for (uint16_t value = 0; value < 256; value++)
+	{
+		code._starts[value] = start;
+		start += code._frequencies[value];
+	}
+
+	code._buildSlots();
+
+	return code;
+}
+
+void RansCode::_buildSlots()
+{
+	_slots.resize(RANS_TOTAL);
+
+	for (uint16_t value = 0; value < 256; value++)
+		memset(_slots.data() + _starts[value], value, _frequencies[value]);
+}
+
+vector<uint16_t> RansCode::Encode(const LayerBuffer& layerData, bool runLength, uint32_t& symbolCount)
+{
+	// start & frequency of every item, symbols & run-length values alike, in layer order
+	vector<pair<uint16_t, uint16_t>> items;
+	items.reserve(layerData.size());
+	symbolCount = 0;
+
+	for (const uint8_t* symbol = layerData.begin(); symbol < layerData.end(); symbol++)
+	{
+		items.push_back(make_pair(_starts[*symbol], _frequencies[*symbol]));
+		symbolCount++;
+
+		if (runLength && (*symbol & 0x0f))
+		{
+			// a uniform item: each of its 1 << bits values gets an equal share
+			uint8_t bits = *symbol & 0x0f, shift = RANS_PROBABILITY_BITS - bits;
+			items.push_back(make_pair(RunLengthValueBits(*++symbol, bits) << shift, 1u << shift));
+		}
+	}
+
+	// rANS encodes back to front; words come out in reverse reading order
+	uint32_t states[RANS_STATES];
+	for (uint8_t s = 0; s < RANS_STATES; s++)
+		states[s] = RANS_LOW;
+
+	vector<uint16_t> words;
+	words.reserve(items.size() + 2 * RANS_STATES);
+
+	for (size_t i = items.size(); i-- > 0; )
+	{
+		uint32_t &state = states[i % RANS_STATES],
+				 start = items[i].first, frequency = items[i].second;
+
+		if (state >= (uint64_t)((RANS_LOW >> RANS_PROBABILITY_BITS) << 16) * frequency)
+		{
+			words.push_back(state & 0xffff);
+			state >>= 16;
+		}
+
+		state = ((state / frequency) << RANS_PROBABILITY_BITS) + (state % frequency) + start;
+	}
+
+	// final states, read first: state 0's low word, then its high word, ...
+	for (int s = RANS_STATES - 1; s >= 0; s--)
+	{
+		words.push_back(states[s] >> 16);
+		words.push_back(states[s] & 0xffff);
+	}
+
+	reverse(words.begin(), words.end());
+
+	return words;
+}
+
+// word position of the layer's bytes (which may not be aligned); reads past the end yield 0
+static inline uint16_t _word(const uint8_t* bytes, size_t wordCount, size_t& position)
+{
+	if (position >= wordCount)
+		return 0;
+
+	uint16_t word;
+	memcpy(&word, bytes + position++ * sizeof(word), sizeof(word));
+
+	return word;
+}
+
+LayerBuffer* RansCode::Decode(const uint8_t* words, size_t wordCount, uint32_t symbolCount, bool runLength)
+{
+	if (symbolCount && _slots.empty())
+		throw "Invalid rANS frequencies.";
+
+	// released if a symbol is invalid
+	unique_ptr<LayerBuffer> layerData(new LayerBuffer(runLength ? 2 * (size_t)symbolCount : symbolCount));
+
+	size_t position = 0;
+	uint32_t states[RANS_STATES];
+
+	for (uint8_t s = 0; s < RANS_STATES; s++)
+	{
+		states[s] = _word(words, wordCount, position);
+		states[s] |= (uint32_t)_word(words, wordCount, position) << 16;
+	}
+
+	const uint32_t mask = RANS_TOTAL - 1;
+	size_t item = 0;
+
+	while (symbolCount--)
+	{
+		uint32_t &state = states[item++ % RANS_STATES],
+				 slot = state & mask;
+		uint8_t symbol = _slots[slot];
+
+		state = _frequencies[symbol] * (state >> RANS_PROBABILITY_BITS) + slot - _starts[symbol];
+
+		if (state < RANS_LOW)
+			state = state << 16 | _word(words, wordCount, position);
+
+		layerData->push(symbol);
+
+		if (runLength && (symbol & 0x0f))
+		{
+			uint8_t bits = symbol & 0x0f;
+
+			if (bits > 8)
+				throw "Invalid run-length symbol.";
+
+			uint8_t shift = RANS_PROBABILITY_BITS - bits;
+			uint32_t &valueState = states[item++ % RANS_STATES],
+					 valueSlot = valueState & mask,
+					 valueBits = valueSlot >> shift;
+
+			valueState = (1u << shift) * (valueState >> RANS_PROBABILITY_BITS) + valueSlot - (valueBits << shift);
+
+			if (valueState < RANS_LOW)
+				valueState = valueState << 16 | _word(words, wordCount, position);
+
+			layerData->push(RunLengthValue(valueBits, bits));
+		}
+	}
+
+	return layerData.release();
+}
@@ -0,0 +1,64 @@
+#ifndef RansCode_h
+#define RansCode_h
+
+#include <iostream>
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+#include "LayerBuffer.h"
+
+using namespace std;
+
+// symbol frequencies sum to 1 << RANS_PROBABILITY_BITS
+#define RANS_PROBABILITY_BITS 12
+
+// interleaved coder states; item i of a layer goes through state i % RANS_STATES
+#define RANS_STATES 2
+
+// states stay in [RANS_LOW, RANS_LOW << 16) & renormalize 16 bits at a time
+#define RANS_LOW (1u << 16)
+
+/*
+	static rANS model for one layer (the alternative to HuffmanCode; HeaderOptions::getRANSCoding)
+
+	serialized:
+		uint16 symbol count
+		uint8 symbols, ascending
+		each symbol's frequency: 1 byte below 0x80, else 2 bytes big-endian with the top bit set
+
+	a layer's data is 16-bit words; the decoder reads RANS_STATES 32-bit states, then renormalizes
+	each state from the words that follow. run-length values (LayerBuffer.h) are coded as uniform
+	items of their bit count, so they cost exactly those bits, as in the Huffman layers
+*/
+class RansCode
+{
+	public:
+		RansCode();
+
+		static RansCode FromWeights(const map<int8_t, uint64_t>&);
+		static RansCode Deserialize(istream&);
+
+		// returns serialized length
+		uint64_t Serialize(ostream&);
+
+		// the layer as words, in reading order; symbolCount is set to the symbols coded (not values)
+		vector<uint16_t> Encode(const LayerBuffer&, bool, uint32_t&);
+
+		// symbolCount symbols (& their run-length values) from wordCount words, read in place
+		//	(e.g. from a mapped file, unaligned)
+		LayerBuffer* Decode(const uint8_t*, size_t, uint32_t, bool);
+
+		uint16_t getFrequency(uint8_t value) { return _frequencies[value]; }
+
+	private:
+		// frequency & cumulative start of each symbol
+		uint16_t _frequencies[256], _starts[256];
+
+		// symbol of each slot of the probability range
+		vector<uint8_t> _slots;
+
+		void _buildSlots();
+};
+
+#endif
@@ -0,0 +1,153 @@
+#include "StripeEncoder.h"
+#include "WorkerPool.h"
+
+#include <assert.h>
+#include <string.h>
+
+StripeEncoder::StripeEncoder(uint32_t width, uint8_t channelCount, uint8_t layerCount, const QuantizationTable& luminance, const QuantizationTable& chrominance, unsigned threadCount)
+	: StripeEncoder(width, channelCount, layerCount, luminance, chrominance, threadCount, false) { }
+
+StripeEncoder::StripeEncoder(uint32_t width, uint8_t channelCount, uint8_t layerCount, const QuantizationTable& luminance, const QuantizationTable& chrominance, unsigned threadCount, bool runLength)
+	: _columns(width / 8), _channelCount(channelCount), _layerCount(layerCount), _threadCount(threadCount), _runLength(runLength),
+	  _luminance(luminance), _chrominance(chrominance)
+{
+	assert(!(width % 8));
+	assert(layerCount <= MAX_LAYERS);
+
+	for (uint8_t l = 0; l < _layerCount; l++)
+		_chunks[l].resize(_channelCount * _columns, LayerBuffer(0));
+}
+
+void StripeEncoder::AddStripe(const Mat& stripe)
+{
+	assert(stripe.depth() == CV_8U && stripe.channels() == _channelCount);
+	assert(stripe.cols == (int)_columns * 8 && !(stripe.rows % 8));
+
+	vector<Mat> channels;
+	split(stripe, channels);
+
+	// -128, DCT, quantization & rounding in one pass
+	_addBlocks(stripe.rows, [&](uint32_t i, uint32_t k, uint32_t j, const QuantizationTable& table, int16_t* coefficients)
+	{
+		BlockTransform::ForwardQuantize(channels[i].ptr<uint8_t>(k) + j, channels[i].step, table, coefficients);
+	});
+}
+
+void StripeEncoder::AddStripe(const vector<Mat>& transformed)
+{
+	assert(transformed.size() == _channelCount);
+	assert(transformed[0].cols == (int)_columns * 8 && !(transformed[0].rows % 8));
+
+	_addBlocks(transformed[0].rows, [&](uint32_t i, uint32_t k, uint32_t j, const QuantizationTable& table, int16_t* coefficients)
+	{
+		int16_t values[BLOCK_ELEMENTS];
+
+		for (int y = 0; y < BLOCK_SIZE; y++)
+			memcpy(&values[y * BLOCK_SIZE], transformed[i].ptr<int16_t>(k + y) + j, BLOCK_SIZE * sizeof(int16_t));
+
+		BlockTransform::Quantize(values, table, coefficients);
+	});
+}
+
+vector<Mat> StripeEncoder::Transform(const Mat& stripe, unsigned threadCount)
+{
+	assert(stripe.depth() == CV_8U && !(stripe.cols % 8) && !(stripe.rows % 8));
+
+	uint32_t columns = stripe.cols / 8;
+
+	vector<Mat> channels, transformed(stripe.channels());
+	split(stripe, channels);
+
+	for (Mat& plane : transformed)
+		plane.create(stripe.rows, stripe.cols, CV_16SC1);
+
+	WorkerPool::Run(stripe.channels() * columns, threadCount, [&](uint32_t chunk)
+	{
+		uint32_t i = chunk / columns, j = (chunk % columns) * 8;
+		int16_t values[BLOCK_ELEMENTS];
+
+		for (uint32_t k = 0; k < (uint32_t)stripe.rows; k += 8)
+		{
+			BlockTransform::Forward(channels[i].ptr<uint8_t>(k) + j, channels[i].step, values);
+
+			for (int y = 0; y < BLOCK_SIZE; y++)
+				memcpy(transformed[i].ptr<int16_t>(k + y) + j, &values[y * BLOCK_SIZE], BLOCK_SIZE * sizeof(int16_t));
+		}
+	});
+
+	return transformed;
+}
+
+void StripeEncoder::_addBlocks(uint32_t rows, const BlockSource& source)
+{
+	const ZigzagLayout& layout = ZigzagLayouts[_layerCount];
+	uint32_t blockRows = rows / 8;
+
+	// one block column of one channel per task
+	WorkerPool::Run(_channelCount * _columns, _threadCount, [&](uint32_t chunk)
+	{
+		uint32_t i = chunk / _columns, j = (chunk % _columns) * 8;
+		const QuantizationTable& table = !i ? _luminance : _chrominance;
+
+		// room for a count & every value of the layer per block (or their run-length symbols)
+		for (uint8_t l = 0; l < _layerCount; l++)
+			_chunks[l][chunk].reserve(_chunks[l][chunk].size() + blockRows * HuffmanTree::_blockCapacity(layout.layerSize(l), _runLength));
+
+		int16_t coefficients[BLOCK_ELEMENTS];
+		int8_t block[BLOCK_ELEMENTS], zigzag[BLOCK_ELEMENTS];
+
+		for (uint32_t k = 0; k < rows; k += 8)
+		{
+			source(i, k, j, table, coefficients);
+
+			// coefficients are stored as 8-bit values
+			for (uint8_t e = 0; e < BLOCK_ELEMENTS; e++)
+				block[e] = saturate_cast<int8_t>(coefficients[e]);
+
+			ZigzagGather(block, BLOCK_SIZE, layout, zigzag);
+
+			for (uint8_t l = 0; l < _layerCount; l++)
+				HuffmanTree::_encodeLayer(&zigzag[layout.layerStart[l]], layout.layerSize(l), _chunks[l][chunk], _runLength);
+		}
+	});
+}
+
+HuffmanTree* StripeEncoder::Finish()
+{
+	return Finish(HUFFMAN_DEFAULT_MAX_LENGTH);
+}
+
+HuffmanTree* StripeEncoder::Finish(uint8_t maxLength)
+{
+	HuffmanTree *tree = new HuffmanTree(_layerCount);
+	tree->_runLength = _runLength;
+
+	tree->_layerData.resize(_layerCount);
+	tree->_valueWeightMaps.resize(_layerCount);
+	tree->_trees.resize(_layerCount);
+	tree->_codes.resize(_layerCount);
+	tree->_ransCodes.resize(_layerCount);
+
+	WorkerPool::Run(_layerCount, _threadCount, [&](uint32_t l)
+	{
+		size_t layerSize = 0;
+		for (LayerBuffer& chunk : _chunks[l])
+			layerSize += chunk.size();
+
+		// per channel, per block column, top to bottom; each chunk is freed once copied
+		LayerBuffer *layerData = new LayerBuffer(layerSize);
+
+		for (LayerBuffer& chunk : _chunks[l])
+		{
+			layerData->append(chunk.begin(), chunk.size());
+			chunk = LayerBuffer(0);
+		}
+
+		tree->_layerData[l] = layerData;
+		tree->_valueWeightMaps[l] = HuffmanTree::_valueWeightMapFromLayer(*layerData, _runLength);
+		tree->_codes[l] = HuffmanCode::FromWeights(*tree->_valueWeightMaps[l], maxLength);
+		tree->_ransCodes[l] = RansCode::FromWeights(*tree->_valueWeightMaps[l]);
+	});
+
+	return tree;
+}
@@ -0,0 +1,67 @@
+#ifndef StripeEncoder_h
+#define StripeEncoder_h
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <functional>
+
+#include "BlockTransform.h"
+#include "HuffmanTree.h"
+#include "LayerBuffer.h"
+
+using namespace std;
+using namespace cv;
+
+// block rows main.cpp pads, converts & hands to the encoder at once
+#define STRIPE_BLOCK_ROWS 16
+
+/*
+	encodes an image stripe by stripe, top to bottom
+
+	only the layer symbols are kept between stripes, per channel & block column, since the
+	file stores each layer column by column; Finish stitches them into that order
+*/
+class StripeEncoder
+{
+	public:
+		// padded width (multiple of 8), channel count, layer count, luminance & chrominance tables, threads
+		StripeEncoder(uint32_t, uint8_t, uint8_t, const QuantizationTable&, const QuantizationTable&, unsigned);
+
+		// run-length layers (HeaderOptions::setRunLengthCoding)
+		StripeEncoder(uint32_t, uint8_t, uint8_t, const QuantizationTable&, const QuantizationTable&, unsigned, bool);
+
+		// -128, DCT, quantize & layer a stripe of CV_8U samples: full width & a multiple of 8 rows
+		void AddStripe(const Mat&);
+
+		// quantize & layer a stripe already transformed by Transform, so several encoders
+		//	(one per quality) share a DCT; output is identical to AddStripe's
+		void AddStripe(const vector<Mat>&);
+
+		// -128 & DCT (BlockTransform::Forward) a stripe of CV_8U samples into one CV_16S
+		//	plane per channel, each block's values in its 8x8 place
+		static vector<Mat> Transform(const Mat&, unsigned);
+
+		// the layers of every stripe added, with their codes (at most maxLength bits; default
+		//	HUFFMAN_DEFAULT_MAX_LENGTH); releases the stripes' symbols
+		HuffmanTree* Finish();
+		HuffmanTree* Finish(uint8_t);
+
+	private:
+		// fills one block's natural-order coefficients: channel, block top row, left column, table
+		typedef function<void (uint32_t, uint32_t, uint32_t, const QuantizationTable&, int16_t*)> BlockSource;
+
+		// layers rows / 8 blocks of every block column, one column per task
+		void _addBlocks(uint32_t, const BlockSource&);
+
+		uint32_t _columns;
+		uint8_t _channelCount, _layerCount;
+		unsigned _threadCount;
+		bool _runLength;
+
+		QuantizationTable _luminance, _chrominance;
+
+		// per layer: symbols of each channel's block columns, channel by channel
+		vector<LayerBuffer> _chunks[MAX_LAYERS];
+};
+
+#endif
@@ -1,5 +1,10 @@
 #include "Utilities.h"
 #include "ifbitstream.h"
+#include "BlockTransform.h"
+#include "WorkerPool.h"
+#include "QualityMetrics.h"
+#include "Instrumentation.h"
+#include "MappedFile.h"
 
 // standard quantization matricies
 //	http://www.ijg.org
@@ -38,6 +43,23 @@ void Utilities::RoundSingleDimMat(Mat* mat)
 	}
 }
 
+void Utilities::PadStripe(const Mat& image, uint32_t top, Mat& stripe)
+{
+	uint32_t width = image.cols, height = image.rows;
+	size_t pixelSize = image.elemSize();
+
+	for (int y = 0; y < stripe.rows; y++)
+	{
+		const uchar* source = image.ptr(min(top + y, height - 1));
+		uchar* destination = stripe.ptr(y);
+
+		memcpy(destination, source, width * pixelSize);
+
+		for (uint32_t x = width; x < (uint32_t)stripe.cols; x++)
+			memcpy(destination + x * pixelSize, source + (width - 1) * pixelSize, pixelSize);
+	}
+}
+
 Mat* Utilities::GenerateQuantizationMatricies(double quality)
 {
 	Mat luminanceOriginal = Mat(8, 8, CV_64FC1, &_dataLuminance),
@@ -68,24 +90,27 @@ Mat* Utilities::GenerateQuantizationMatricies(double quality)
 
 HuffmanTree* Utilities::OpenFile(string filePath, HeaderOptions &header)
 {
-	ifbitstream inFile(filePath);
-	header = HeaderOptions::Deserialize(inFile);
-    
-    HuffmanTree* tree = HuffmanTree::Deserialize(inFile, header);
-    
-    inFile.close();
-    
-    return tree;
+	return OpenFile(filePath, header, WorkerPool::DefaultThreadCount());
+}
+
+HuffmanTree* Utilities::OpenFile(string filePath, HeaderOptions &header, unsigned threadCount)
+{
+	PICTS_STAGE("decode.open_file");
+	return HuffmanTree::Deserialize(filePath, header, threadCount);
+}
+
+HuffmanTree* Utilities::OpenFile(const uint8_t* data, size_t size, HeaderOptions &header, unsigned threadCount)
+{
+	PICTS_STAGE("decode.open_file");
+	return HuffmanTree::Deserialize(data, size, header, threadCount);
 }
 
 HeaderOptions Utilities::ReadHeader(string filePath)
 {
-    ifbitstream inFile(filePath);
-    HeaderOptions header = HeaderOptions::Deserialize(inFile);
-    
-    inFile.close();
-    
-    return header;
+    MappedFile file(filePath);
+    ifbitstream inFile(file.data(), file.size());
+
+    return HeaderOptions::Deserialize(inFile);
 }
 
 Mat Utilities::ToMat (HuffmanTree *tree, HeaderOptions *header)
@@ -95,187 +120,101 @@ Mat Utilities::ToMat (HuffmanTree *tree, HeaderOptions *header)
 
 Mat Utilities::ToMat (HuffmanTree *tree, HeaderOptions *header, uint8_t maxLayers)
 {
+	// 0: every layer, at full size
+	if (!maxLayers)
+		maxLayers = 8;
+
 	Mat *inImage = tree->ToImage(*header, maxLayers);
 
-	DecompressImage(inImage, header);
+	// k layers decode at k/8 scale
+	DecompressImage(inImage, header, min(maxLayers, (uint8_t)8), WorkerPool::DefaultThreadCount());
 
-	if (maxLayers == 8)
-	{
-		Mat outputImage = (*inImage)(Rect(0, 0, header->getWidth(), header->getHeight()));
+	Mat outputImage = SamplesToMat(*inImage, header, maxLayers);
+	delete inImage;
 
-		if (header->getYUVColor())
-			cvtColor(outputImage, outputImage, CV_YCrCb2BGR);
+	return outputImage;
+}
 
-		outputImage.convertTo(outputImage, CV_16SC3);
-		add(outputImage, 128, outputImage);
-		outputImage.convertTo(outputImage, CV_8UC3);
+Mat Utilities::SamplesToMat (const Mat& samples, HeaderOptions *header, uint8_t maxLayers)
+{
+	// full size drops the padding; scaled previews keep it
+	Mat outputImage = maxLayers >= 8 ? samples(Rect(0, 0, header->getWidth(), header->getHeight())) : samples;
 
+	if (!header->getYUVColor())
 		return outputImage;
-	}
-	
-	Mat outputImage(header->getPadHeight() / 8 * maxLayers, header->getPadWidth() / 8 * maxLayers, CV_16SC3, Scalar(0));
-	
-	for (uint32_t j = 0; j < header->getPadWidth(); j += 8)
-		for (uint32_t k = 0; k < header->getPadHeight(); k+= 8)
-		{
-			Rect sourceRect(j, k, maxLayers, maxLayers);
-			Rect destRect(j / 8 * maxLayers, k / 8 * maxLayers, maxLayers, maxLayers);
 
-			(*inImage)(sourceRect).copyTo(outputImage(destRect));
-		}
+	Mat colorImage;
+	cvtColor(outputImage, colorImage, CV_YCrCb2BGR);
 
-	if (header->getYUVColor())
-		cvtColor(outputImage, outputImage, CV_YCrCb2BGR);
-	
-	add(outputImage, 128, outputImage);
-	outputImage.convertTo(outputImage, CV_8UC3);
-	
-	return outputImage;
+	return colorImage;
 }
 
 void Utilities::DecompressImage(Mat *inImage, HeaderOptions *header)
 {
+	DecompressImage(inImage, header, WorkerPool::DefaultThreadCount());
+}
+
+void Utilities::DecompressImage(Mat *inImage, HeaderOptions *header, unsigned threadCount)
+{
+	DecompressImage(inImage, header, BLOCK_SIZE, threadCount);
+}
+
+void Utilities::DecompressImage(Mat *inImage, HeaderOptions *header, uint8_t blockSize, unsigned threadCount)
+{
+	PICTS_STAGE("decode.decompress_image");
+
 	Mat* quantizationMatricies = GenerateQuantizationMatricies((double)header->getQuality());
-	Mat luminance = quantizationMatricies[0],
-		chrominance = quantizationMatricies[1];
-	
-	// cout << "luminance: " << endl << luminance << endl << "===============================================" << endl;
-	// cout << "chrominance: " << endl << chrominance << endl << "===============================================" << endl;
+	QuantizationTable luminance(quantizationMatricies[0].ptr<double>()),
+		chrominance(quantizationMatricies[1].ptr<double>());
+	delete [] quantizationMatricies;
 	
-	vector<Mat> inChannels;
+	vector<Mat> inChannels, outChannels;
 	split(*inImage, inChannels);
 	uint8_t channelCount = inImage->channels();
 
-	// decompress
 	for (int i = 0; i < channelCount; i++)
+		outChannels.push_back(Mat(header->getPadHeight() / 8 * blockSize, header->getPadWidth() / 8 * blockSize, CV_8UC1));
+
+	uint32_t columns = header->getPadWidth() / 8;
+
+	// decompress, one block column of one channel per task
+	WorkerPool::Run(channelCount * columns, threadCount, [&](uint32_t chunk)
 	{
-		Mat currentChannel = inChannels[i];
-		for (uint32_t j = 0; j < header->getPadWidth(); j += 8)
-			for (uint32_t k = 0; k < header->getPadHeight(); k+= 8)
+		uint32_t i = chunk / columns, j = (chunk % columns) * 8;
+		Mat &currentChannel = inChannels[i],
+			&outputChannel = outChannels[i];
+
+		int16_t coefficients[BLOCK_ELEMENTS];
+
+		for (uint32_t k = 0; k < header->getPadHeight(); k+= 8)
+		{
+			for (uint32_t y = 0; y < 8; y++)
 			{
-				Mat currentBlock = currentChannel(Rect(j, k, 8, 8));
-				currentBlock.convertTo(currentBlock, CV_64F);
-
-				// if (!i && !j && !k)
-				// 	cout << "original: " << endl << currentBlock << endl << "===============================================" << endl;
-				
-				// if (header->getSubtract128())
-				// {
-				// 	subtract(currentBlock, 128.0, currentBlock);
-				
-				// 	// if (!i && !j && !k)
-				// 	// 	cout << "after -128.0: " << endl << currentBlock << endl << "===============================================" << endl;
-				// }
-				
-				// dequantization
-				multiply(currentBlock, !i ? luminance : chrominance, currentBlock);
-
-				// if (!i && !j && !k)
-				// 	cout << "after dequantization: " << endl << currentBlock << endl << "===============================================" << endl;
-				
-				// iDCT
-				dct(currentBlock, currentBlock, DCT_INVERSE);
-
-				// if (!i && !j && !k)
-				// 	cout << "after iDCT: " << endl << currentBlock << endl << "===============================================" << endl;
-				
-				// if -128 cli flag
-				// if (header->getSubtract128())
-				// {
-				// 	add(currentBlock, 128.0, currentBlock);
-				//
-				// 	if (!i && !j && !k)
-				// 		cout << "after +128: " << endl << currentBlock << endl << "===============================================" << endl;
-				// }
-
-				RoundSingleDimMat(&currentBlock);
-
-				// if (!i && !j && !k)
-				// 	cout << "after _roundSingleDimMat (final): " << endl << currentBlock << endl << "===============================================" << endl;
-
-				currentBlock.copyTo(currentChannel(Rect(j, k, 8, 8)));
+				const int8_t* row = currentChannel.ptr<int8_t>(k + y) + j;
+
+				for (uint32_t x = 0; x < 8; x++)
+					coefficients[y * 8 + x] = row[x];
 			}
-	}
 
-	merge(inChannels, *inImage);
-	// inImage->convertTo(*inImage, CV_8SC3);
-	// inImage->convertTo(*inImage, CV_8UC3);
+			// dequantization, iDCT, +128 & clamp in one pass
+			BlockTransform::DequantizeInverseScaled(coefficients, !i ? luminance : chrominance, blockSize, outputChannel.ptr<uint8_t>(k / 8 * blockSize) + j / 8 * blockSize, outputChannel.step);
+		}
+	});
+
+	merge(outChannels, *inImage);
 }
 
 // algorithms from: http://docs.opencv.org/2.4/doc/tutorials/highgui/video-input-psnr-ssim/video-input-psnr-ssim.html
 double Utilities::getPSNR(const Mat& I1, const Mat& I2)
 {
-    Mat s1;
-    absdiff(I1, I2, s1);       // |I1 - I2|
-    s1.convertTo(s1, CV_32F);  // cannot make a square on 8 bits
-    s1 = s1.mul(s1);           // |I1 - I2|^2
-
-    Scalar s = sum(s1);        // sum elements per channel
-
-    double sse = s.val[0] + s.val[1] + s.val[2]; // sum channels
-
-    if( sse <= 1e-10) // for small values return zero
-        return 0;
-    else
-    {
-        double mse  = sse / (double)(I1.channels() * I1.total());
-        double psnr = 10.0 * log10((255 * 255) / mse);
-        return psnr;
-    }
+	return QualityMetrics::ComparePSNR(I1, I2, 1).psnr;
 }
 
 Scalar Utilities::getMSSIM(const Mat& i1, const Mat& i2)
 {
-    const double C1 = 6.5025, C2 = 58.5225;
-    /***************************** INITS **********************************/
-    int d = CV_32F;
-
-    Mat I1, I2;
-    i1.convertTo(I1, d);            // cannot calculate on one byte large values
-    i2.convertTo(I2, d);
-
-    Mat I2_2   = I2.mul(I2);        // I2^2
-    Mat I1_2   = I1.mul(I1);        // I1^2
-    Mat I1_I2  = I1.mul(I2);        // I1 * I2
-
-    /*************************** END INITS **********************************/
-
-    Mat mu1, mu2;                   // PRELIMINARY COMPUTING
-    GaussianBlur(I1, mu1, Size(11, 11), 1.5);
-    GaussianBlur(I2, mu2, Size(11, 11), 1.5);
-
-    Mat mu1_2   =   mu1.mul(mu1);
-    Mat mu2_2   =   mu2.mul(mu2);
-    Mat mu1_mu2 =   mu1.mul(mu2);
-
-    Mat sigma1_2, sigma2_2, sigma12;
-
-    GaussianBlur(I1_2, sigma1_2, Size(11, 11), 1.5);
-    sigma1_2 -= mu1_2;
-
-    GaussianBlur(I2_2, sigma2_2, Size(11, 11), 1.5);
-    sigma2_2 -= mu2_2;
-
-    GaussianBlur(I1_I2, sigma12, Size(11, 11), 1.5);
-    sigma12 -= mu1_mu2;
-
-    ///////////////////////////////// FORMULA ////////////////////////////////
-    Mat t1, t2, t3;
-
-    t1 = 2 * mu1_mu2 + C1;
-    t2 = 2 * sigma12 + C2;
-    t3 = t1.mul(t2);                 // t3 = ((2*mu1_mu2 + C1).*(2*sigma12 + C2))
-
-    t1 = mu1_2 + mu2_2 + C1;
-    t2 = sigma1_2 + sigma2_2 + C2;
-    t1 = t1.mul(t2);                 // t1 =((mu1_2 + mu2_2 + C1).*(sigma1_2 + sigma2_2 + C2))
-
-    Mat ssim_map;
-    divide(t3, t1, ssim_map);        // ssim_map =  t3./t1;
-
-    Scalar mssim = mean(ssim_map);   // mssim = average of ssim map
+	ImageQuality quality = QualityMetrics::Compare(i1, i2, 1);
 
-	return mssim;
+	return Scalar(quality.channelSSIM[0], quality.channelSSIM[1], quality.channelSSIM[2], quality.channelSSIM[3]);
 }
 
 // http://stackoverflow.com/questions/10167534/how-to-find-out-what-type-of-a-mat-object-is-with-mattype-in-opencv
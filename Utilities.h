@@ -15,14 +15,30 @@ class Utilities
 {
 	public:
 		static void RoundSingleDimMat(Mat*);
+
+		// fills stripe (its own size, at least the image's width) from the image's rows at top on,
+		//	replicating the last image row to padded rows & last pixel to padded columns
+		static void PadStripe(const Mat&, uint32_t, Mat&);
 		static Mat* GenerateQuantizationMatricies(double);
 
+		// decodes the layers on DefaultThreadCount() / threadCount threads
 		static HuffmanTree* OpenFile(string, HeaderOptions&);
+		static HuffmanTree* OpenFile(string, HeaderOptions&, unsigned);
+		// a .picts file already in memory
+		static HuffmanTree* OpenFile(const uint8_t*, size_t, HeaderOptions&, unsigned);
         static HeaderOptions ReadHeader(string filePath);
 		static Mat ToMat (HuffmanTree*, HeaderOptions*);
 		static Mat ToMat (HuffmanTree*, HeaderOptions*, uint8_t);
+		// crops padded CV_8UC3 samples (8 layers; fewer are already at k/8 scale) & converts them to BGR
+		static Mat SamplesToMat (const Mat&, HeaderOptions*, uint8_t);
+		// replaces a CV_8SC3 coefficient image with its CV_8UC3 samples
 		static void DecompressImage(Mat*, HeaderOptions*);
+		static void DecompressImage(Mat*, HeaderOptions*, unsigned);
+
+		// at blockSize/8 scale: blockSize x blockSize samples per block, from that many coefficients
+		static void DecompressImage(Mat*, HeaderOptions*, uint8_t, unsigned);
 
+		// single-threaded QualityMetrics comparisons: over all channels & per-channel mean SSIM
 		static double getPSNR(const Mat&, const Mat&);
 		static Scalar getMSSIM(const Mat&, const Mat&);
 
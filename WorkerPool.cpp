@@ -0,0 +1,52 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+void WorkerPool::Run(uint32_t taskCount, unsigned threadCount, function<void(uint32_t)> task)
+{
+	atomic<uint32_t> nextTask(0);
+	exception_ptr failure;
+	mutex failureMutex;
+
+	// tasks are handed out in order, one at a time
+	auto worker = [&]()
+	{
+		try
+		{
+			for (uint32_t i = nextTask++; i < taskCount; i = nextTask++)
+				task(i);
+		}
+		catch (...)
+		{
+			lock_guard<mutex> lock(failureMutex);
+
+			if (!failure)
+				failure = current_exception();
+
+			// stop handing out tasks
+			nextTask = taskCount;
+		}
+	};
+
+	vector<thread> threads;
+	for (unsigned i = 1; i < min(threadCount, taskCount); i++)
+		threads.push_back(thread(worker));
+
+	worker();
+
+	for (thread& current : threads)
+		current.join();
+
+	if (failure)
+		rethrow_exception(failure);
+}
+
+unsigned WorkerPool::DefaultThreadCount()
+{
+	return max(thread::hardware_concurrency(), 1u);
+}
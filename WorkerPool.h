@@ -0,0 +1,20 @@
+#ifndef WorkerPool_h
+#define WorkerPool_h
+
+#include <stdint.h>
+#include <functional>
+
+using namespace std;
+
+class WorkerPool
+{
+	public:
+		// run task(0 .. taskCount - 1) on up to threadCount threads (the caller's included);
+		//	returns once every task finished & rethrows the first exception a task threw
+		static void Run(uint32_t, unsigned, function<void(uint32_t)>);
+
+		// hardware threads, at least 1
+		static unsigned DefaultThreadCount();
+};
+
+#endif
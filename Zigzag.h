@@ -0,0 +1,95 @@
+#ifndef Zigzag_h
+#define Zigzag_h
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define MAX_LAYERS 8
+
+/*
+	zig-zag order of an 8x8 block & the layer of every position, computed at compile time
+
+	layers are the block's anti-diagonals; with fewer than 8 layers, all the remaining
+	diagonals go into the last layer (see HuffmanTree::FromImage)
+*/
+
+struct ZigzagEntry
+{
+	uint8_t row, col;
+
+	// 0-based layer & position within that layer
+	uint8_t layer, layerIndex;
+};
+
+struct ZigzagLayout
+{
+	ZigzagEntry entries[64];
+
+	// zig-zag index where each layer starts; layerStart[layerCount] is 64
+	uint8_t layerStart[MAX_LAYERS + 1];
+
+	uint8_t layerCount;
+
+	uint8_t layerSize(uint8_t layer) const { return layerStart[layer + 1] - layerStart[layer]; }
+};
+
+constexpr ZigzagLayout _zigzagLayout(uint8_t layerCount)
+{
+	ZigzagLayout layout {};
+
+	// 0 layers behaves as 1
+	layout.layerCount = layerCount ? layerCount : 1;
+
+	uint8_t index = 0, layerIndex = 0;
+
+	for (uint8_t diagonal = 0; diagonal < 15; diagonal++)
+	{
+		uint8_t layer = diagonal < layout.layerCount - 1 ? diagonal : layout.layerCount - 1,
+				low = diagonal > 7 ? diagonal - 7 : 0,
+				high = diagonal < 7 ? diagonal : 7;
+
+		if (!diagonal || layer != layout.entries[index - 1].layer)
+		{
+			layout.layerStart[layer] = index;
+			layerIndex = 0;
+		}
+
+		// odd diagonals run down-left, even diagonals up-right
+		for (uint8_t step = 0; step <= high - low; step++)
+		{
+			uint8_t row = diagonal % 2 ? low + step : high - step;
+
+			layout.entries[index++] = ZigzagEntry { row, (uint8_t)(diagonal - row), layer, layerIndex++ };
+		}
+	}
+
+	for (uint8_t layer = layout.layerCount; layer <= MAX_LAYERS; layer++)
+		layout.layerStart[layer] = 64;
+
+	return layout;
+}
+
+// indexed by layer count
+constexpr ZigzagLayout ZigzagLayouts[MAX_LAYERS + 1] =
+{
+	_zigzagLayout(0), _zigzagLayout(1), _zigzagLayout(2), _zigzagLayout(3), _zigzagLayout(4),
+	_zigzagLayout(5), _zigzagLayout(6), _zigzagLayout(7), _zigzagLayout(8)
+};
+
+// copy a block (row-major, rows stride elements apart) into zig-zag order
+template <typename T>
+inline void ZigzagGather(const T* block, size_t stride, const ZigzagLayout& layout, T* zigzag)
+{
+	for (uint8_t i = 0; i < 64; i++)
+		zigzag[i] = block[layout.entries[i].row * stride + layout.entries[i].col];
+}
+
+// copy zig-zag ordered values back into a block
+template <typename T>
+inline void ZigzagScatter(const T* zigzag, const ZigzagLayout& layout, T* block, size_t stride)
+{
+	for (uint8_t i = 0; i < 64; i++)
+		block[layout.entries[i].row * stride + layout.entries[i].col] = zigzag[i];
+}
+
+#endif
@@ -1,38 +1,146 @@
 #import "ifbitstream.h"
 
+#include <assert.h>
+
+SpanBuffer::SpanBuffer() { }
+
+SpanBuffer::SpanBuffer(const uint8_t* bytes, size_t size)
+{
+	// never written through
+	char* begin = (char*)bytes;
+	setg(begin, begin, begin + size);
+}
+
+void SpanBuffer::setPosition(size_t position)
+{
+	setg(eback(), eback() + min(position, (size_t)(egptr() - eback())), egptr());
+}
+
+SpanBuffer::pos_type SpanBuffer::seekoff(off_type offset, ios_base::seekdir direction, ios_base::openmode mode)
+{
+	off_type base = direction == ios_base::beg ? 0 : direction == ios_base::cur ? gptr() - eback() : egptr() - eback();
+
+	if (!(mode & ios_base::in) || base + offset < 0)
+		return pos_type(off_type(-1));
+
+	// past the end reads nothing, as a file
+	setPosition(base + offset);
+	return pos_type(position());
+}
+
+SpanBuffer::pos_type SpanBuffer::seekpos(pos_type position, ios_base::openmode mode)
+{
+	return seekoff(off_type(position), ios_base::beg, mode);
+}
+
 ifbitstream::ifbitstream(const char * fileName)
-	: _currentByte(0), _location(8), _bitLength(sizeof(_currentByte) * 8), _byteLength(sizeof(_currentByte)), ifstream(fileName, ifstream::binary | ifstream::in) { }
+	: ifstream(fileName, ifstream::binary | ifstream::in),
+	  _bits(0), _bitCount(0), _buffer(IFBITSTREAM_BUFFER_SIZE), _bufferPosition(0), _bufferLength(0), _bytes(_buffer.data()), _memory(NULL), _memorySize(0) { }
 
 ifbitstream::ifbitstream(string fileName) : ifbitstream(fileName.c_str()) {  }
 
+ifbitstream::ifbitstream(const uint8_t* bytes, size_t size)
+	: _bits(0), _bitCount(0), _bufferPosition(0), _bufferLength(0),
+	  _bytes(bytes), _memory(bytes), _memorySize(size), _span(bytes, size)
+{
+	// byte-level reads come from the memory too
+	basic_ios<char>::rdbuf(&_span);
+}
+
 uint8_t ifbitstream::readBit()
 {
 	return readBits(1);
 }
 
-uint8_t ifbitstream::readBits(uint8_t length)
+uint64_t ifbitstream::readBits(uint8_t length)
 {
-	if (length > 8) throw "Langth cannot be >8.";
+	if (length > IFBITSTREAM_MAX_BITS) throw "Length cannot be >56.";
+
+	uint64_t value = peek(length);
+	consume(length);
+
+	return value;
+}
+
+void ifbitstream::_refill()
+{
+	size_t tail = _bufferLength - _bufferPosition;
+
+	if (_memory)
+	{
+		// no copy: look ahead over the rest of the memory, from the first unread byte
+		size_t start = _span.position() - tail;
 
-	uint8_t value = 0;
+		_bytes = _memory + start;
+		_bufferLength = _memorySize - start;
+		_span.setPosition(_memorySize);
+	}
+	else
+	{
+		// keep the unread tail & top the buffer up from the file
+		memmove(_buffer.data(), _buffer.data() + _bufferPosition, tail);
 
-	for (uint8_t i = 0; i < length; i++)
+		read((char*)_buffer.data() + tail, _buffer.size() - tail);
+		_bufferLength = tail + gcount();
+	}
+
+	_bufferPosition = 0;
+
+	if (_bufferLength >= 8)
 	{
-		if (_location == _bitLength)
-		{
-			read((char*)&_currentByte, 1);
-			_location = 0;
-		}
-
-		value = (value << 1) | ((_currentByte >> (_bitLength - _location - 1)) & 0x01);
-		_location++;
+		_bits |= _loadWord(_bytes) >> _bitCount;
+		_bufferPosition += (63 - _bitCount) >> 3;
+		_bitCount |= 56;
+
+		return;
 	}
 
-	return value;
+	// end of file: take what's left a byte at a time
+	while (_bitCount <= 56 && _bufferPosition < _bufferLength)
+	{
+		_bits |= (uint64_t)_bytes[_bufferPosition++] << (56 - _bitCount);
+		_bitCount += 8;
+	}
 }
 
 void ifbitstream::skipByte()
 {
 	// flush rest of byte
-	readBits(_bitLength - _location);
-}
\ No newline at end of file
+	consume(_bitCount % 8);
+
+	// hand look-ahead bytes back to the stream, so byte reads continue where the bits ended
+	std::streamoff unread = _bitCount / 8 + (_bufferLength - _bufferPosition);
+
+	if (unread)
+	{
+		clear();
+		seekg(-unread, ios::cur);
+	}
+
+	_bits = 0;
+	_bitCount = 0;
+	_bufferPosition = _bufferLength = 0;
+}
+
+const uint8_t* ifbitstream::unreadBytes(size_t& count)
+{
+	assert(!_bitCount && _bufferPosition == _bufferLength);
+	count = 0;
+
+	if (_memory)
+	{
+		count = _memorySize - _span.position();
+		return _memory + _span.position();
+	}
+
+	if (!*this)
+		return NULL;
+
+	streampos position = tellg();
+	seekg(0, ios::end);
+
+	count = tellg() - position;
+	seekg(position);
+
+	return NULL;
+}
@@ -2,22 +2,109 @@
 #define ifbitstream_h
 
 #include <fstream>
+#include <streambuf>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
 
 using namespace std;
 
+// bytes pulled from the file per ifstream::read
+#define IFBITSTREAM_BUFFER_SIZE (1 << 16)
+
+// widest look-ahead; a refill always leaves at least this many bits in the register
+#define IFBITSTREAM_MAX_BITS 56
+
+// read-only streambuf over bytes in memory: byte-level reads & seeks without a file
+class SpanBuffer : public streambuf
+{
+	public:
+		SpanBuffer();
+		SpanBuffer(const uint8_t*, size_t);
+
+		size_t position() { return gptr() - eback(); }
+		void setPosition(size_t);
+
+	protected:
+		pos_type seekoff(off_type, ios_base::seekdir, ios_base::openmode);
+		pos_type seekpos(pos_type, ios_base::openmode);
+};
+
 class ifbitstream : public ifstream
 {
 	public:
 		ifbitstream(const char *);
 		ifbitstream(string);
 
+		// reads bytes in memory (e.g. a MappedFile's), which must outlive the stream; bits
+		//	are read straight from them, without copying through a buffer
+		ifbitstream(const uint8_t*, size_t);
+
 		uint8_t readBit();
-		uint8_t readBits(uint8_t);
+		uint64_t readBits(uint8_t);
+
+		// look ahead up to 56 bits without moving the read position
+		//	bits past the end of the file read as 0
+		uint64_t peek(uint8_t length)
+		{
+			if (_bitCount < length)
+			{
+				if (_bufferLength - _bufferPosition >= 8)
+				{
+					// word refill: tops the register up to 56..63 bits
+					_bits |= _loadWord(_bytes + _bufferPosition) >> _bitCount;
+					_bufferPosition += (63 - _bitCount) >> 3;
+					_bitCount |= 56;
+				}
+				else
+					_refill();
+			}
 
+			return length ? _bits >> (64 - length) : 0;
+		}
+
+		void consume(uint8_t length)
+		{
+			if (length > _bitCount)
+				length = _bitCount;
+
+			_bits = length < 64 ? _bits << length : 0;
+			_bitCount -= length;
+		}
+
+		// align to the next byte boundary; byte-level reads continue from there
 		void skipByte();
 
+		// the bytes left from the byte-level read position: in place for memory streams (seekg
+		//	past them once used), NULL for files; count is set either way. no bits may be pending
+		const uint8_t* unreadBytes(size_t&);
+
 	private:
-		uint8_t _currentByte, _location, _bitLength, _byteLength;
+		static uint64_t _loadWord(const uint8_t* bytes)
+		{
+			uint64_t word;
+			memcpy(&word, bytes, sizeof(word));
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			word = __builtin_bswap64(word);
+#endif
+
+			return word;
+		}
+
+		void _refill();
+
+		// bits are left-aligned; bits below _bitCount are either 0 or the bytes at _bufferPosition
+		uint64_t _bits;
+		uint8_t _bitCount;
+
+		vector<uint8_t> _buffer;
+		size_t _bufferPosition, _bufferLength;
+
+		// where the look-ahead bytes are (_buffer, or _memory itself); _memory is NULL for files
+		const uint8_t *_bytes, *_memory;
+		size_t _memorySize;
+		SpanBuffer _span;
 };
 
-#endif
\ No newline at end of file
+#endif
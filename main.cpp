@@ -1,13 +1,24 @@
 #include <iostream>
+#include <fstream>
 #include <algorithm>
 #include <map>
+#include <memory>
+#include <sstream>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
 #include <opencv2/opencv.hpp>
 
 #include "HeaderOptions.h"
 #include "Parameters.h"
 #include "HuffmanTree.h"
+#include "StripeEncoder.h"
 #include "ofbitstream.h"
+#include "ProgressiveDecoder.h"
 #include "Utilities.h"
+#include "QualityMetrics.h"
+#include "WorkerPool.h"
+#include "Instrumentation.h"
 
 using namespace std;
 using namespace cv;
@@ -24,6 +35,13 @@ using namespace cv;
 // 	{110, 136, 123, 123, 123, 136, 154, 136}
 // };
 
+string _compressFile(Parameters&, string, string, unsigned);
+string _decompressFile(string, string, unsigned);
+string _writeFile(HeaderOptions, HuffmanTree*, string, const Mat*, unsigned);
+string _qualityFileName(string, uint8_t);
+string _batchOutputFileName(string, string);
+vector<string> _batchFiles(string);
+void _writeStats(string);
 void _imagePSNRCompare(string, string);
 
 int main (int argc, char** argv)
@@ -45,16 +63,131 @@ int main (int argc, char** argv)
 	Parameters parameters = Parameters::ParseCommandLine(argc, argv);
 	// cout << "Parameters: " << parameters << endl;
 
-	// open file / read into cv:Mat
-	// file has been stat'd at this point, so we know it exists
-	Mat inputImage = imread(parameters.InputFileName, CV_LOAD_IMAGE_COLOR);
+	Instrumentation::SetEnabled(parameters.StatsFileName != "");
 
-	if (!inputImage.data)
+	if (parameters.Decode)
+	{
+		try
+		{
+			cout << _decompressFile(parameters.InputFileName, parameters.OutputFileName, parameters.ThreadCount ? parameters.ThreadCount : WorkerPool::DefaultThreadCount()) << endl;
+		}
+		catch (const char* error)
+		{
+			cerr << error << ": " << parameters.InputFileName << endl;
+			exit(1);
+		}
+
+		_writeStats(parameters.StatsFileName);
+		return 0;
+	}
+
+	if (!parameters.Batch)
+	{
+		try
+		{
+			cout << _compressFile(parameters, parameters.InputFileName, parameters.OutputFileName, parameters.ThreadCount ? parameters.ThreadCount : 1) << endl;
+		}
+		catch (const char* error)
+		{
+			cerr << error << ": " << parameters.InputFileName << endl;
+			exit(1);
+		}
+
+		_writeStats(parameters.StatsFileName);
+		return 0;
+	}
+
+	// batch: one file per task, each encoded on its task's thread
+	vector<string> inputFiles;
+
+	try
+	{
+		inputFiles = _batchFiles(parameters.InputFileName);
+	}
+	catch (const char* error)
+	{
+		cerr << error << ": " << parameters.InputFileName << endl;
+		exit(1);
+	}
+
+	vector<string> outputFiles(inputFiles.size()), results(inputFiles.size());
+
+	// inputs sharing a name (x.png & x.jpg, or x.png in two directories with -o) would write one
+	//	file from two threads: only the first is encoded, the others are reported
+	map<string, string> firstInputs;
+
+	for (size_t i = 0; i < inputFiles.size(); i++)
+	{
+		outputFiles[i] = _batchOutputFileName(inputFiles[i], parameters.OutputFileName);
+
+		auto first = firstInputs.insert(make_pair(outputFiles[i], inputFiles[i]));
+
+		if (!first.second)
+			results[i] = inputFiles[i] + "\tSame output file as " + first.first->second;
+	}
+
+	WorkerPool::Run(inputFiles.size(), parameters.ThreadCount ? parameters.ThreadCount : WorkerPool::DefaultThreadCount(), [&](uint32_t i)
+	{
+		if (results[i] != "")
+			return;
+
+		// one bad file doesn't stop the batch
+		try
+		{
+			results[i] = _compressFile(parameters, inputFiles[i], outputFiles[i], 1);
+		}
+		catch (const char* error)
+		{
+			results[i] = inputFiles[i] + "\t" + error;
+		}
+	});
+
+	// one table, in input order
+	for (string& result : results)
+		cout << result << endl;
+
+	_writeStats(parameters.StatsFileName);
+	return 0;
+}
+
+// the instrumentation's JSON, if asked for
+void _writeStats(string statsFileName)
+{
+	if (statsFileName == "")
+		return;
+
+	if (statsFileName == "-")
 	{
-		cerr << "Error reading image file: " << parameters.InputFileName << endl;
+		Instrumentation::WriteJSON(cout);
+		return;
+	}
+
+	ofstream statsFile(statsFileName);
+
+	if (!statsFile.is_open())
+	{
+		cerr << "Error writing stats file: " << statsFileName << endl;
 		exit(1);
 	}
 
+	Instrumentation::WriteJSON(statsFile);
+}
+
+string _compressFile(Parameters& parameters, string inputFileName, string outputFileName, unsigned threadCount)
+{
+	// open file / read into cv:Mat
+	Mat inputImage;
+	{
+		PICTS_STAGE("encode.read");
+		inputImage = imread(inputFileName, CV_LOAD_IMAGE_COLOR);
+	}
+
+	if (!inputImage.data)
+		throw "Error reading image file";
+
+	PICTS_COUNT("images", 1);
+	PICTS_COUNT("pixels", inputImage.total());
+
 	// start header
 	uint32_t width = inputImage.size().width,
 			 height = inputImage.size().height;
@@ -66,137 +199,181 @@ int main (int argc, char** argv)
 	options.setYUVColor(parameters.YUVConversion);
 	options.setSubtract128(parameters.Subtract128);
 	options.setHuffmanCoding(parameters.HuffmanCoding);
-	options.setQuality(parameters.Quality != 0 ? parameters.Quality : DEFAULT_QUALITY);
+	options.setRunLengthCoding(parameters.RunLengthCoding);
 	options.setLayerCount(8);
 
 	// cout << "width: " << options.getWidth() << endl;
 	// cout << "height: " << options.getHeight() << endl;
 
-	// pad image, if necessary
-	int padWidth = width % 8 ? 8 - (width % 8) : 0,
-		padHeight = height % 8 ? 8 - (height % 8) : 0;
-	
-	if (padWidth || padHeight)
-	{
-		// copy to padded Mat & replicate last pixel to border
-		Mat paddedImage = Mat(Size(width + padWidth, height + padHeight), inputImage.type());
+	// pad to whole blocks, if necessary
+	uint32_t padWidth = width % 8 ? width + 8 - (width % 8) : width,
+			 padHeight = height % 8 ? height + 8 - (height % 8) : height;
 
-		inputImage.copyTo(paddedImage(Rect(0, 0, width, height)));
+	options.setPadWidth(padWidth);
+	options.setPadHeight(padHeight);
 
-		Mat row = inputImage.row(height - 1);
-		for (uint32_t i = height; i < height + padHeight; i++)
-			// if needs height, replicate last image row to outer padded row
-			row.copyTo(paddedImage(Rect(0, i, width, 1)));
+	// cout << "width: " << width << " | " << padWidth << endl;
+	// cout << "height: " << height << " | " << padHeight << endl;
 
-		Mat col = inputImage.col(width - 1);
-		for (uint32_t i = width; i < width + padWidth; i++)
-			// if needs width, replicate last image col to outer padded col
-			col.copyTo(paddedImage(Rect(i, 0, 1, height)));
+	// one encoder per quality; with several, each stripe is transformed once & quantized by each
+	vector<uint8_t> qualities = parameters.Qualities;
+	if (qualities.empty())
+		qualities.push_back(parameters.Quality != 0 ? parameters.Quality : DEFAULT_QUALITY);
 
-		// fill-in corner with last (H - 1 x W - 1) pixel
-		Vec3b cornerColor = inputImage.at<Vec3b>(Point(width - 1, height - 1));
-		for (uint32_t w = width; w < (width + padWidth); w++)
-			for (uint32_t h = height; h < (height + padHeight); h++)
-				paddedImage.at<Vec3b>(Point(w, h)) = cornerColor;
+	vector<StripeEncoder> encoders;
+	encoders.reserve(qualities.size());
 
-		inputImage = paddedImage;
+	for (uint8_t quality : qualities)
+	{
+		Mat* quantizationMatricies = Utilities::GenerateQuantizationMatricies((double)quality);
+		QuantizationTable luminance(quantizationMatricies[0].ptr<double>()),
+			chrominance(quantizationMatricies[1].ptr<double>());
+		delete [] quantizationMatricies;
+
+		// -128, DCT, quantization & layering of every 8x8 block, a stripe at a time:
+		//	only one padded, color-converted stripe exists besides the image & the layers
+		encoders.emplace_back(padWidth, inputImage.channels(), options.getLayerCount(), luminance, chrominance, threadCount, parameters.RunLengthCoding);
 	}
 
-	padWidth += width;
-	padHeight += height;
+	// kept per thread, so batch files of the same width reuse it
+	static thread_local Mat stripe;
 
-	options.setPadWidth(padWidth);
-	options.setPadHeight(padHeight);
+	for (uint32_t top = 0; top < padHeight; top += STRIPE_BLOCK_ROWS * 8)
+	{
+		{
+			PICTS_STAGE("encode.pad");
 
-	// cout << "width: " << width << " | " << padWidth << endl;
-	// cout << "height: " << height << " | " << padHeight << endl;
+			stripe.create(min(padHeight - top, (uint32_t)STRIPE_BLOCK_ROWS * 8), padWidth, inputImage.type());
+			Utilities::PadStripe(inputImage, top, stripe);
 
-	// convert color to YUV
-	if (parameters.YUVConversion)
-		cvtColor(inputImage, inputImage, CV_BGR2YCrCb);
-	
-	// convert to signed float for subtract & DCT
-	inputImage.convertTo(inputImage, CV_64FC1);
+			// without --metrics, the image isn't needed past its last stripe
+			if (!parameters.Metrics && top + stripe.rows >= padHeight)
+				inputImage.release();
+		}
+
+		// convert color to YUV
+		if (parameters.YUVConversion)
+		{
+			PICTS_STAGE("encode.color");
+			cvtColor(stripe, stripe, CV_BGR2YCrCb);
+		}
 
-	// get direct access to channels
-	vector<Mat> channels;
-	split(inputImage, channels);
-	short channelCount = inputImage.channels();
+		PICTS_STAGE("encode.transform");
 
-	Mat* quantizationMatricies = Utilities::GenerateQuantizationMatricies((double)parameters.Quality);
-	Mat luminance = quantizationMatricies[0],
-		chrominance = quantizationMatricies[1];
-	
-	// divide into 8x8 blocks
-	for (int i = 0; i < channelCount; i++)
+		if (encoders.size() == 1)
+			encoders[0].AddStripe(stripe);
+		else
+		{
+			vector<Mat> transformed = StripeEncoder::Transform(stripe, threadCount);
+
+			for (StripeEncoder& encoder : encoders)
+				encoder.AddStripe(transformed);
+		}
+	}
+
+	// with --metrics, the input is the PSNR reference; no need to read it again
+	const Mat* original = parameters.Metrics ? &inputImage : NULL;
+	ostringstream results;
+
+	// one file & results row per quality, each tree released before the next is built
+	for (size_t q = 0; q < qualities.size(); q++)
 	{
-		Mat currentChannel = channels[i];
-		for (uint32_t j = 0; j < padWidth; j += 8)
-			for (uint32_t k = 0; k < padHeight; k+= 8)
+		options.setQuality(qualities[q]);
+
+		HuffmanTree* tree;
 		{
-			Mat currentBlock = currentChannel(Rect(j, k, 8, 8));
-
-			// if (!i && !j && !k)
-			// 	cout << "original: " << endl << currentBlock << endl << "===============================================" << endl;
-
-			// if -128 cli flag
-			// if (parameters.Subtract128)
-			{
-				subtract(currentBlock, 128.0, currentBlock);
-
-				// if (!i && !j && !k)
-				// 	cout << "after -128: " << endl << currentBlock << endl << "===============================================" << endl;
-			}
-
-			// DCT
-			dct(currentBlock, currentBlock);
-
-			// if (!i && !j && !k)
-			// 	cout << "after DCT: " << endl << currentBlock << endl << "===============================================" << endl;
-			
-			// quantization
-			divide(currentBlock, !i ? luminance : chrominance, currentBlock);
-
-			// if (!i && !j && !k)
-			// 	cout << "after quantization: " << endl << currentBlock << endl << "===============================================" << endl;
-
-			Utilities::RoundSingleDimMat(&currentBlock);
-			
-			// if (!i && !j && !k)
-			// 	cout << "after _roundSingleDimMat (final): " << endl << currentBlock << endl << "===============================================" << endl;
-			
-			currentBlock.copyTo(currentChannel(Rect(j, k, 8, 8)));
+			PICTS_STAGE("encode.code_build");
+			tree = encoders[q].Finish(parameters.MaxCodeLength != 0 ? parameters.MaxCodeLength : HUFFMAN_DEFAULT_MAX_LENGTH);
 		}
+
+		tree->setRANSCoding(options.getRANSCoding());
+
+		results << (q ? "\n" : "")
+				<< _writeFile(options, tree, qualities.size() > 1 ? _qualityFileName(outputFileName, qualities[q]) : outputFileName, original, threadCount);
+	}
+
+	return results.str();
+}
+
+// decodes every layer of a .picts file to an image file; returns its results row
+string _decompressFile(string inputFileName, string outputFileName, unsigned threadCount)
+{
+	HeaderOptions header;
+	unique_ptr<HuffmanTree> tree(Utilities::OpenFile(inputFileName, header, threadCount));
+
+	Mat image = Utilities::ToMat(tree.get(), &header);
+
+	PICTS_COUNT("images", 1);
+	PICTS_COUNT("pixels", image.total());
+
+	{
+		PICTS_STAGE("decode.write");
+
+		if (!imwrite(outputFileName, image))
+			throw "Error writing output file";
 	}
 
-	Mat outputImage;
-	merge(channels, outputImage);
-	outputImage.convertTo(outputImage, CV_8SC3);
+	ostringstream results;
+	results << outputFileName << "\t" << header.getWidth() << "\t" << header.getHeight() << "\t" << (int)tree->getLayerCount();
+
+	return results.str();
+}
 
-	HuffmanTree* tree;
-	tree = HuffmanTree::FromImage(&outputImage, options.getLayerCount());
+// writes the header, trees & layers of tree (deleted once written); returns its results row:
+//	each layer's size, and its PSNR & SSIM against original if given (decoded from the in-memory layers)
+string _writeFile(HeaderOptions options, HuffmanTree* layers, string outputFileName, const Mat* original, unsigned threadCount)
+{
+	// released however this returns
+	unique_ptr<HuffmanTree> tree(layers);
+	ofbitstream file(outputFileName);
 
-	ofbitstream file(parameters.OutputFileName);
+	if (!file.is_open())
+		throw "Error writing output file";
 
-	Mat original = imread(parameters.InputFileName, IMREAD_COLOR);
-	cout << parameters.OutputFileName << "\t" << options.getWidth() << "\t" << options.getHeight() << "\t" << (int)options.getQuality() << "\t";
+	ostringstream results;
+	results << outputFileName << "\t" << options.getWidth() << "\t" << options.getHeight() << "\t" << (int)options.getQuality() << "\t";
 
-	// write header
+	// write header; the layer table is filled-in below
 	options.Serialize(file);
+	unique_ptr<ProgressiveDecoder> decoder(original ? new ProgressiveDecoder(options, threadCount) : NULL);
+
 	// write trees & layers
 	for (uint8_t i = 0; i < options.getLayerCount(); i++)
 	{
-		uint64_t treeSize = tree->SerializeTree(file, i);
-		uint64_t layerSize = tree->SerializeLayer(file, i);
-		cout << (treeSize + layerSize) << "\t";
+		LayerLocation location;
+		uint64_t treeSize, layerSize;
+		{
+			PICTS_STAGE("encode.serialize");
 
-		Mat currentLayerImage = Utilities::ToMat(tree, &options, i + 1);
-		Mat resizedOriginal = original.clone();
+			location.treeOffset = file.tellp();
+			treeSize = tree->SerializeTree(file, i);
 
-		resize(resizedOriginal, resizedOriginal, currentLayerImage.size());
+			location.dataOffset = file.tellp();
+			layerSize = tree->SerializeLayer(file, i);
+		}
+
+		location.treeSize = location.dataOffset - location.treeOffset;
+		location.dataSize = (uint64_t)file.tellp() - location.dataOffset;
+		options.setLayerLocation(i, location);
+
+		results << (treeSize + layerSize) << "\t";
+
+		// SerializeLayer counts the layer's symbols
+		PICTS_COUNT_LAYER(i, "tree_bytes", location.treeSize);
+		PICTS_COUNT_LAYER(i, "data_bytes", location.dataSize);
+		PICTS_COUNT_LAYER(i, "tree_entries", tree->getCode(i).getSymbols().size());
+
+		if (!decoder)
+			continue;
+
+		PICTS_STAGE("encode.metrics");
+
+		// refine the previous layers' full-size image with this layer: only the blocks it changes are decoded again
+		decoder->AddLayer(*tree->getLayerData(i));
+		Mat currentLayerImage = decoder->ToMat();
 
 		// compare PSNR to original
-		double psnrEachother = Utilities::getPSNR(currentLayerImage, resizedOriginal);
+		ImageQuality quality = QualityMetrics::Compare(currentLayerImage, *original, threadCount);
 
 		// resize(resizedOriginal, resizedOriginal, original.size());
 		// resize(currentLayerImage, currentLayerImage, original.size());
@@ -204,30 +381,109 @@ int main (int argc, char** argv)
 		// psnrDifferences.push_back(psnrEachother);
 
 		// print results
-		cout << psnrEachother << "\t";
+		results << quality.psnr << "\t" << quality.ssim << "\t";
 	}
 
-	cout << endl;
+	// rewrite header with the layer table
+	file.seekp(0);
+	options.Serialize(file);
 
 	file.close();
 
 	// HeaderOptions header;
-	// HuffmanTree *inTree = Utilities::OpenFile(parameters.OutputFileName, header);
+	// HuffmanTree *inTree = Utilities::OpenFile(outputFileName, header);
 
 	// vector<int> compression_params;
     // compression_params.push_back(CV_IMWRITE_PNG_COMPRESSION);
     // compression_params.push_back(100);
-	// imwrite(parameters.OutputFileName + ".jpg", Utilities::ToMat(inTree, &header, 7), compression_params);
+	// imwrite(outputFileName + ".jpg", Utilities::ToMat(inTree, &header, 7), compression_params);
 
 	// imshow("inTree", Utilities::ToMat(inTree, &header, 8));
 	// waitKey(0);
 
 	// delete inTree;
-	// return 0;
 
-	// _imagePSNRCompare(parameters.OutputFileName, parameters.InputFileName);
-	
-	return 0;
+	// _imagePSNRCompare(outputFileName, inputFileName);
+
+	return results.str();
+}
+
+// <name>_<quality>.<extension>
+string _qualityFileName(string fileName, uint8_t quality)
+{
+	size_t lastSlash = fileName.find_last_of("/"), lastDot = fileName.find_last_of(".");
+
+	if (lastDot == string::npos || (lastSlash != string::npos && lastDot < lastSlash))
+		lastDot = fileName.size();
+
+	return fileName.substr(0, lastDot) + "_" + to_string(quality) + fileName.substr(lastDot);
+}
+
+// <output directory or input's directory>/<input name>.picts
+string _batchOutputFileName(string inputFile, string outputDirectory)
+{
+	string outputFile = inputFile;
+
+	size_t lastSlash = inputFile.find_last_of("/"), lastDot = inputFile.find_last_of(".");
+	if (lastDot != string::npos && (lastSlash == string::npos || lastDot > lastSlash))
+		outputFile = inputFile.substr(0, lastDot);
+
+	if (outputDirectory != "")
+		outputFile = outputDirectory + "/" + outputFile.substr(lastSlash == string::npos ? 0 : lastSlash + 1);
+
+	return outputFile + ".picts";
+}
+
+vector<string> _batchFiles(string path)
+{
+	vector<string> files;
+	struct stat buffer;
+
+	// a directory: its regular files, by name
+	if (!stat(path.c_str(), &buffer) && S_ISDIR(buffer.st_mode))
+	{
+		DIR* directory = opendir(path.c_str());
+
+		if (!directory)
+			throw "Error reading batch directory";
+
+		for (struct dirent* entry = readdir(directory); entry; entry = readdir(directory))
+		{
+			string file = path + "/" + entry->d_name;
+
+			string name(entry->d_name);
+
+			// skip hidden files & earlier outputs
+			if (name[0] == '.' || (name.size() > 6 && name.substr(name.size() - 6) == ".picts"))
+				continue;
+
+			if (!stat(file.c_str(), &buffer) && S_ISREG(buffer.st_mode))
+				files.push_back(file);
+		}
+
+		closedir(directory);
+		sort(files.begin(), files.end());
+
+		return files;
+	}
+
+	// otherwise a manifest, one path per line; - reads it from stdin
+	ifstream manifestFile;
+	if (path != "-")
+	{
+		manifestFile.open(path);
+
+		if (!manifestFile.is_open())
+			throw "Error reading batch manifest";
+	}
+
+	istream& manifest = path != "-" ? manifestFile : cin;
+
+	for (string line; getline(manifest, line); )
+		if (line != "")
+			files.push_back(line);
+
+	return files;
 }
 
 void _imagePSNRCompare(string pictsFilePath, string originalFilePath)
@@ -1,42 +1,46 @@
 #include "ofbitstream.h"
 
 ofbitstream::ofbitstream(const char * fileName)
-	: _currentByte(0), _location(0), _bitLength(sizeof(_currentByte) * 8), _byteLength(sizeof(_currentByte)), ofstream(fileName, ofstream::binary | ofstream::out) { }
+	: ofstream(fileName, ofstream::binary | ofstream::out), _bits(0), _bitCount(0), _buffer(OFBITSTREAM_BUFFER_SIZE), _bufferLength(0) { }
 
 ofbitstream::ofbitstream(string fileName) : ofbitstream(fileName.c_str()) { }
 
 void ofbitstream::writeBit(uint8_t value) { writeBits(value, 1); }
 
-void ofbitstream::writeBits(uint8_t value, uint8_t length)
+void ofbitstream::_drainBits()
 {
-	if (length > 8) throw "Langth cannot be >8.";
-
-	for (uint8_t i = 0; i < length; i++)
+	// move whole bytes from the top of the register to the buffer
+	while (_bitCount >= 8)
 	{
-		if (_location == _bitLength)
-		{
-			write((char*)&_currentByte, _byteLength);
-			_currentByte = 0;
-			_location = 0;
-		}
-
-		_currentByte = (_currentByte << 1) | (value >> (length - (i + 1)) & 0x1);
-		_location++;
+		if (_bufferLength == _buffer.size())
+			_writeBuffer();
+
+		_buffer[_bufferLength++] = (char)(_bits >> 56);
+		_bits <<= 8;
+		_bitCount -= 8;
 	}
 }
 
+void ofbitstream::_writeBuffer()
+{
+	if (_bufferLength)
+		ofstream::write(_buffer.data(), _bufferLength);
+
+	_bufferLength = 0;
+}
+
 void ofbitstream::flush()
 {
-	// only write last byte if the location is >0
+	// pad the last byte with 0s
 	//	user is responsible to know if the last usable bit
-	if (_location)
-	{
-		// shift last byte to end
-		_currentByte <<= (_bitLength - _location);
-		ofstream::write((char*)&_currentByte, 1);
-		_currentByte = _location = 0;
-	}
-	
+	if (_bitCount % 8)
+		_bitCount += 8 - _bitCount % 8;
+
+	_drainBits();
+	_writeBuffer();
+
+	_bits = _bitCount = 0;
+
 	ofstream::flush();
 }
 
@@ -44,4 +48,4 @@ void ofbitstream::close()
 {
 	flush();
 	ofstream::close();
-}
\ No newline at end of file
+}
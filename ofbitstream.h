@@ -2,9 +2,16 @@
 #define ofbitstream_h
 
 #include <fstream>
+#include <vector>
 
 using namespace std;
 
+// bytes collected before each ofstream::write
+#define OFBITSTREAM_BUFFER_SIZE (1 << 16)
+
+// widest value accepted by writeBits; the register always has room for it after draining
+#define OFBITSTREAM_MAX_BITS 57
+
 class ofbitstream : public ofstream
 {
 	public:
@@ -12,13 +19,35 @@ class ofbitstream : public ofstream
 		ofbitstream(string);
 
 		void writeBit(uint8_t);
-		void writeBits(uint8_t, uint8_t);
+
+		// writes the low length bits of value, most significant first
+		//	bits are buffered until flush(); flush before any byte-level write or seek
+		void writeBits(uint64_t value, uint8_t length)
+		{
+			if (length > OFBITSTREAM_MAX_BITS) throw "Length cannot be >57.";
+
+			if (_bitCount + length > 64)
+				_drainBits();
+
+			if (length)
+			{
+				_bits |= (value & (~0ull >> (64 - length))) << (64 - _bitCount - length);
+				_bitCount += length;
+			}
+		}
 
 		void flush();
 		void close();
-	
+
 	private:
-		uint8_t _currentByte, _location, _bitLength, _byteLength;
+		void _drainBits();
+		void _writeBuffer();
+
+		uint64_t _bits;
+		uint8_t _bitCount;
+
+		vector<char> _buffer;
+		size_t _bufferLength;
 };
 
-#endif
\ No newline at end of file
+#endif